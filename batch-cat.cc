@@ -0,0 +1,256 @@
+#include <iostream>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "batch-cat.h"
+#include "thread-pool.h"
+
+namespace fusism {
+
+  BatchCat::BatchCat(ObjectDatabase &odb, int in_fd,
+		     int out_fd, unsigned threads,
+		     Prefetcher::Backend prefetch) : odb_(odb),
+						     in_fd_(in_fd),
+						     threads_(threads),
+						     prefetch_(prefetch),
+						     paths_(odb, trees_),
+						     in_(kInputChunk),
+						     in_pos_(0),
+						     in_len_(0),
+						     eof_(false),
+						     out_(out_fd) { }
+
+  int64_t BatchCat::run() {
+    if (threads_ != 1) {
+      return runParallel();
+    }
+    int64_t unreadable = 0;
+    std::string line;
+    Writer write = [this](const void *data, size_t len) -> bool {
+      return out_.write(data, len);
+    };
+    while (readLine(line)) {
+      Status s = cat(odb_, paths_, line, write);
+      if (s == kFailed) {
+	return -1;
+      }
+      unreadable += s == kUnreadable;
+    }
+    return out_.flush() ? unreadable : -1;
+  }
+
+  // the input is read (and the output written) on this thread, the
+  // lookups run on the pool. answers are queued in input order and
+  // go out as soon as everything before them has. the queue is
+  // bounded both in entries and in buffered bytes, objects too large
+  // to buffer are left to this thread to stream when their turn comes
+  int64_t BatchCat::runParallel() {
+    struct Answer {
+      std::string line;
+      std::vector<uint8_t> out;
+      Status status;
+      bool ready;
+    };
+
+    // queued lookups are at least a pool's worth ahead of the
+    // workers, that much can be read ahead
+    Prefetcher prefetcher(prefetch_);
+    ThreadPool pool(threads_);
+    // the odb is shared, a resolver (and its buffer) is per worker
+    std::vector<std::unique_ptr<PathResolver> > paths;
+    for (unsigned w=0; w<pool.size(); w++) {
+      paths.emplace_back(new PathResolver(odb_, trees_));
+    }
+    const size_t max_in_flight = kInFlightPerThread*pool.size();
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::shared_ptr<Answer> > queue;
+    size_t buffered = 0;
+
+    int64_t unreadable = 0;
+    bool input = true;
+    bool failed = false;
+    std::string line;
+    while (!failed) {
+      // everything at the head that is done goes out
+      std::unique_lock<std::mutex> l(lock);
+      while (!queue.empty() && queue.front()->ready) {
+	std::shared_ptr<Answer> a = queue.front();
+	queue.pop_front();
+	buffered -= a->out.size();
+	l.unlock();
+	Status s = a->status;
+	if (s == kTooLarge) {
+	  s = cat(odb_, paths_, a->line, [this](const void *data, size_t len) -> bool {
+	      return out_.write(data, len);
+	    });
+	} else if (!out_.write(a->out.data(), a->out.size())) {
+	  s = kFailed;
+	}
+	unreadable += s == kUnreadable;
+	failed |= s == kFailed;
+	l.lock();
+      }
+      if (failed) {
+	break;
+      }
+
+      bool room = queue.size() < max_in_flight && buffered < kMaxBuffered;
+      // a blocking read would hold back answers that are on their
+      // way, wait for those first
+      if (input && room && (queue.empty() || inputReady())) {
+	l.unlock();
+	if (!readLine(line)) {
+	  input = false;
+	  continue;
+	}
+	ObjectId id;
+	if (ObjectId::fromHex(line.c_str(), id)) {
+	  odb_.prefetch(id, prefetcher);
+	}
+	std::shared_ptr<Answer> a(new Answer());
+	a->line = line;
+	a->status = kFailed;
+	a->ready = false;
+	l.lock();
+	queue.push_back(a);
+	l.unlock();
+	pool.submit([&, a]() {
+	    int w = pool.currentWorker();
+	    Status s = cat(odb_, *paths[w], a->line,
+			   [&](const void *data, size_t len) -> bool {
+		const uint8_t *d = static_cast<const uint8_t *>(data);
+		a->out.insert(a->out.end(), d, d + len);
+		return true;
+	      }, kMaxBufferedObject);
+	    std::lock_guard<std::mutex> g(lock);
+	    a->status = s;
+	    a->ready = true;
+	    buffered += a->out.size();
+	    ready.notify_one();
+	  });
+	continue;
+      }
+      if (queue.empty()) {
+	break;
+      }
+      ready.wait(l, [&]() { return queue.front()->ready; });
+    }
+    pool.wait();
+    if (failed) {
+      return -1;
+    }
+    return out_.flush() ? unreadable : -1;
+  }
+
+  bool BatchCat::inputReady() {
+    if (in_pos_ < in_len_ || eof_) {
+      return true;
+    }
+    struct pollfd p = { in_fd_, POLLIN, 0 };
+    return poll(&p, 1, 0) > 0;
+  }
+
+  bool BatchCat::readLine(std::string &line) {
+    line.clear();
+    for (;;) {
+      const char *start = in_.data() + in_pos_;
+      const void *nl = memchr(start, '\n', in_len_ - in_pos_);
+      if (nl != nullptr) {
+	size_t n = static_cast<const char *>(nl) - start;
+	line.append(start, n);
+	in_pos_ += n + 1;
+	return true;
+      }
+      line.append(start, in_len_ - in_pos_);
+      in_pos_ = in_len_ = 0;
+      if (eof_) {
+	return !line.empty();
+      }
+      // about to block on the input, whoever is writing it may
+      // well be waiting for the answers so far
+      if (out_.pending() > 0 && !inputReady() && !out_.flush()) {
+	return false;
+      }
+      ssize_t n = read(in_fd_, in_.data(), in_.size());
+      if (n < 0) {
+	if (errno == EINTR) continue;
+	perror("read");
+	eof_ = true;
+      } else if (n == 0) {
+	eof_ = true;
+      } else {
+	in_len_ = n;
+      }
+    }
+  }
+
+  BatchCat::Status BatchCat::cat(ObjectDatabase &odb, PathResolver &paths,
+				 const std::string &line,
+				 const Writer &write, off64_t max_size) {
+    // like git, the whole line is the name (paths may have blanks)
+    const std::string &name = line;
+    ObjectId id;
+    uint32_t mode;
+    bool header = false;
+    bool too_large = false;
+    obj_type_t type;
+    off64_t size;
+    // the header goes out once type and size are known, right
+    // before the contents (or right after the lookup when empty).
+    // first is how much of the object came with the first piece,
+    // all of it if the object was resolved in memory: there is no
+    // point in leaving that to be done again
+    auto writeHeader = [&](off64_t first) -> bool {
+      if (max_size >= 0 && size > max_size && first < size) {
+	too_large = true;
+	return false;
+      }
+      header = true;
+      std::string h = id.hex() + " " + typeToStr(type) + " " +
+	std::to_string(size) + "\n";
+      return write(h.data(), h.size());
+    };
+    ssize_t n = -1;
+    bool resolved = ObjectId::fromHex(name.c_str(), id) ||
+      paths.resolve(name, id, mode);
+    if (resolved) {
+      n = odb.stream(id, type, size, [&](const uint8_t *data, size_t len) -> bool {
+	  return (header || writeHeader(len)) && write(data, len);
+	});
+    }
+    if (too_large) {
+      return kTooLarge;
+    }
+    if (n < 0) {
+      if (header) {
+	// half an object is out already, there is no telling the
+	// reader where it stops
+	std::cerr << name << " failed mid object\n";
+	return kFailed;
+      }
+      std::string m = name + " missing\n";
+      if (!write(m.data(), m.size())) {
+	return kFailed;
+      }
+      if (resolved && odb.contains(id)) {
+	std::cerr << name << " cannot be read\n";
+	return kUnreadable;
+      }
+      return kMissing;
+    }
+    if (!header && !writeHeader(size)) {
+      return kFailed;
+    }
+    return write("\n", 1) ? kFound : kFailed;
+  }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "object-database.h"
+#include "output-buffer.h"
+#include "path-resolver.h"
+#include "prefetcher.h"
+#include "tree-cache.h"
+
+namespace fusism {
+  // answers object lookups the way git cat-file --batch does: one
+  // object name per input line (a sha1, or <rev>:<path>, see
+  // PathResolver), and for each
+  //   <sha1> <type> <size>\n<contents>\n
+  // or, if there is no such object
+  //   <input> missing\n
+  // the object database (its packs, mappings and caches) stays warm
+  // across lookups. output is buffered, and flushed whenever the
+  // input runs dry so callers waiting on an answer get it.
+  // with more than one thread lookups run on a pool, sharing the
+  // object database, and the answers are put back in input order
+  // before they go out. the pack entries of the lookups queued
+  // for the pool are read ahead with prefetch, so the workers don't
+  // stall on page faults one object at a time
+  struct BatchCat {
+    enum : size_t {
+      kInputChunk = 64 << 10,
+      // lookups handed to the pool ahead of the output, per thread
+      kInFlightPerThread = 64,
+      // answers waiting for their turn take at most about this much
+      kMaxBuffered = 64 << 20,
+      // objects larger than this are not buffered, they are streamed
+      // out by the writer once their turn comes. deltas are whole
+      // in memory once resolved, those are buffered at any size
+      kMaxBufferedObject = 1 << 20,
+    };
+
+    // threads == 0 uses one thread per core, 1 does the lookups
+    // on the calling thread
+    BatchCat(ObjectDatabase &odb, int in_fd, int out_fd, unsigned threads=1,
+	     Prefetcher::Backend prefetch=Prefetcher::kAuto);
+    // returns the number of objects that are there but could not be
+    // read (missing ones are not an error, as with git), -1 if the
+    // output failed
+    int64_t run();
+  private:
+    BatchCat(const BatchCat&);
+    BatchCat& operator=(const BatchCat&);
+
+    enum Status {
+      kFound,
+      kMissing,
+      // there, but corrupt. answered as missing
+      kUnreadable,
+      // larger than the max_size asked for and streamed rather
+      // than resolved in memory, nothing was written
+      kTooLarge,
+      // the output is broken past recovery
+      kFailed,
+    };
+    typedef std::function<bool(const void *data, size_t len)> Writer;
+
+    int64_t runParallel();
+    // next input line without its newline, false at the end
+    bool readLine(std::string &line);
+    // true if readLine would not block
+    bool inputReady();
+    // writes the answer for line through write
+    Status cat(ObjectDatabase &odb, PathResolver &paths, const std::string &line,
+	       const Writer &write, off64_t max_size=-1);
+
+    ObjectDatabase &odb_;
+    int in_fd_;
+    unsigned threads_;
+    Prefetcher::Backend prefetch_;
+    // parsed trees, shared by every thread's resolver
+    TreeCache trees_;
+    PathResolver paths_;
+    std::vector<char> in_;
+    size_t in_pos_;
+    size_t in_len_;
+    bool eof_;
+    OutputBuffer out_;
+  };
+}
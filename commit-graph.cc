@@ -0,0 +1,233 @@
+// on https://git-scm.com/docs/gitformat-commit-graph
+
+#include <iostream>
+#include <fstream>
+#include <sys/fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <endian.h>
+
+#include "commit-graph.h"
+
+namespace fusism {
+
+CommitGraph::CommitGraph(const std::string &git_path) : count_(0) {
+  // shallow clones and grafts give commits other parents than the
+  // ones the graph has recorded, git doesn't use it then either
+  if (access((git_path + "/shallow").c_str(), F_OK) == 0 ||
+      access((git_path + "/info/grafts").c_str(), F_OK) == 0) {
+    return;
+  }
+  std::string info = git_path + "/objects/info";
+  // a split graph wins over a single file, git writes one or the
+  // other
+  std::ifstream chain(info + "/commit-graphs/commit-graph-chain");
+  if (chain) {
+    std::string hash;
+    while (std::getline(chain, hash)) {
+      if (hash.empty()) continue;
+      if (!addLayer(info + "/commit-graphs/graph-" + hash + ".graph")) {
+	// the layers above can point at anything in this one
+	layers_.clear();
+	count_ = 0;
+	return;
+      }
+    }
+    return;
+  }
+  if (access((info + "/commit-graph").c_str(), F_OK) == 0) {
+    addLayer(info + "/commit-graph");
+  }
+}
+
+bool CommitGraph::addLayer(const std::string &file) {
+  std::unique_ptr<Layer> l(new Layer(file));
+  if (!l->load(count_) || l->addr_[7] != layers_.size()) {
+    std::cerr << file << " cannot be used\n";
+    return false;
+  }
+  count_ += l->count_;
+  layers_.push_back(std::move(l));
+  return true;
+}
+
+CommitGraph::Layer::Layer(const std::string &file) : file_name_(file),
+						      map_(-1),
+						      len_(0),
+						      addr_(nullptr),
+						      base_(0),
+						      count_(0),
+						      fanout_(-1),
+						      oids_(-1),
+						      data_(-1),
+						      edges_(-1),
+						      edges_len_(0) { }
+
+uint32_t CommitGraph::Layer::read32(off64_t offset) {
+  uint32_t v;
+  memcpy(&v, addr_ + offset, sizeof(v));
+  return ntohl(v);
+}
+
+bool CommitGraph::Layer::chunk(uint32_t id, off64_t &offset, off64_t &len) {
+  uint8_t chunks = addr_[6];
+  // the entry after the last one marks where the last chunk ends
+  for (int c=0; c<chunks; c++) {
+    off64_t entry = kHeaderSize + c*kChunkEntrySize;
+    if (read32(entry) != id) {
+      continue;
+    }
+    uint64_t begin, end;
+    memcpy(&begin, addr_ + entry + 4, sizeof(begin));
+    memcpy(&end, addr_ + entry + kChunkEntrySize + 4, sizeof(end));
+    begin = be64toh(begin);
+    end = be64toh(end);
+    // the checksum follows the last chunk
+    if (begin > end || end > (uint64_t)len_ - 20) {
+      std::cerr << file_name_ << " chunk out of bounds\n";
+      return false;
+    }
+    offset = begin;
+    len = end - begin;
+    return true;
+  }
+  return false;
+}
+
+bool CommitGraph::Layer::load(uint32_t base) {
+  base_ = base;
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  map_ = MemoryMappedFile(fd, MemoryMappedFile::kWholeFile);
+  len_ = map_.size();
+  addr_ = map_.span(0, len_);
+  if (addr_ == nullptr || len_ < kHeaderSize) {
+    std::cerr << file_name_ << " mmap failed\n";
+    return false;
+  }
+  if (memcmp(addr_, "CGPH", 4)) {
+    std::cerr << file_name_ << " not a commit-graph\n";
+    return false;
+  }
+  if (addr_[4] != 1 || addr_[5] != 1) {
+    std::cerr << file_name_ << " unsupported version\n";
+    return false;
+  }
+  uint8_t chunks = addr_[6];
+  if (len_ < kHeaderSize + (chunks+1)*kChunkEntrySize + 20) {
+    std::cerr << file_name_ << " truncated\n";
+    return false;
+  }
+
+  off64_t fanout_len, oids_len, data_len;
+  if (!chunk(kOidFanout, fanout_, fanout_len) ||
+      !chunk(kOidLookup, oids_, oids_len) ||
+      !chunk(kCommitData, data_, data_len)) {
+    std::cerr << file_name_ << " required chunk missing\n";
+    return false;
+  }
+  if (!chunk(kExtraEdges, edges_, edges_len_)) {
+    edges_len_ = 0;
+  }
+  if (fanout_len != 256*sizeof(uint32_t)) {
+    std::cerr << file_name_ << " bad fanout\n";
+    return false;
+  }
+  count_ = fanout(255);
+  if (oids_len != (off64_t)count_*20 || data_len != (off64_t)count_*kCommitDataSize) {
+    std::cerr << file_name_ << " tables don't match the fanout\n";
+    return false;
+  }
+  // as in the idx, find() trusts every entry
+  for (int n=1; n<256; n++) {
+    if (fanout(n) < fanout(n - 1)) {
+      std::cerr << file_name_ << " non-monotonic fanout\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+CommitGraph::Layer *CommitGraph::layer(uint32_t pos) {
+  for (auto &l : layers_) {
+    if (pos < l->base_ + l->count_) {
+      return l.get();
+    }
+  }
+  return nullptr;
+}
+
+// every layer has its own sorted table, the newest ones are
+// looked at first
+int64_t CommitGraph::find(const ObjectId &id) {
+  for (auto l = layers_.rbegin(); l != layers_.rend(); ++l) {
+    Layer &g = **l;
+    uint32_t lo = id.bytes[0] == 0 ? 0 : g.fanout(id.bytes[0] - 1);
+    uint32_t hi = g.fanout(id.bytes[0]);
+    const uint8_t *table = g.addr_ + g.oids_;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo)/2;
+      int cmp = id.compare(table + (off64_t)mid*20);
+      if (cmp == 0) return g.base_ + mid;
+      if (cmp > 0) lo = mid + 1;
+      else hi = mid;
+    }
+  }
+  return -1;
+}
+
+ObjectId CommitGraph::id(uint32_t pos) {
+  Layer *g = layer(pos);
+  if (g == nullptr) {
+    return ObjectId();
+  }
+  return ObjectId::fromRaw(g->addr_ + g->oids_ + (off64_t)(pos - g->base_)*20);
+}
+
+bool CommitGraph::commit(uint32_t pos, Commit &c) {
+  Layer *g = layer(pos);
+  if (g == nullptr) {
+    return false;
+  }
+  off64_t at = g->data_ + (off64_t)(pos - g->base_)*kCommitDataSize;
+  c.tree = ObjectId::fromRaw(g->addr_ + at);
+  c.parents.clear();
+  uint32_t p1 = g->read32(at + 20);
+  uint32_t p2 = g->read32(at + 24);
+  uint32_t gen = g->read32(at + 28);
+  // generation in the upper 30 bits, the 2 low ones are bits 33
+  // and 34 of the date
+  c.generation = gen >> 2;
+  c.date = ((int64_t)(gen & 3) << 32) | g->read32(at + 32);
+
+  if (p1 != kNoParent) {
+    c.parents.push_back(p1);
+  }
+  if (p2 & kMoreParents) {
+    // an octopus, the parents past the first are in the edge list
+    // from there on, the last one has the top bit set
+    off64_t e = (off64_t)(p2 & ~kMoreParents)*sizeof(uint32_t);
+    for (;; e += sizeof(uint32_t)) {
+      if (e + (off64_t)sizeof(uint32_t) > g->edges_len_) {
+	std::cerr << g->file_name_ << " edge out of bounds\n";
+	return false;
+      }
+      uint32_t p = g->read32(g->edges_ + e);
+      c.parents.push_back(p & ~kMoreParents);
+      if (p & kMoreParents) break;
+    }
+  } else if (p2 != kNoParent) {
+    c.parents.push_back(p2);
+  }
+  for (auto p : c.parents) {
+    if (p >= count_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
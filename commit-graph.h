@@ -0,0 +1,95 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "memory-mapped-file.h"
+#include "object-id.h"
+
+namespace fusism {
+
+// reads objects/info/commit-graph, or the layers listed in
+// objects/info/commit-graphs/commit-graph-chain. tree, parents,
+// generation and date of a commit come straight from the mapped
+// tables, the commit itself is never inflated. positions are global
+// across the layers, the base layer first, as the parent tables use
+struct CommitGraph {
+  // what the graph knows of a commit. parents are graph positions
+  struct Commit {
+    ObjectId tree;
+    std::vector<uint32_t> parents;
+    uint32_t generation;
+    int64_t date;
+  };
+
+  // git_path is the .git directory. the graph is left invalid in
+  // a shallow repository or one with grafts
+  CommitGraph(const std::string &git_path);
+
+  bool valid() { return !layers_.empty(); }
+  uint32_t count() { return count_; }
+  // position of id or -1
+  int64_t find(const ObjectId &id);
+  ObjectId id(uint32_t pos);
+  // false if pos or one of its parents is out of bounds
+  bool commit(uint32_t pos, Commit &c);
+
+private:
+  CommitGraph(const CommitGraph&);
+  CommitGraph& operator=(const CommitGraph&);
+
+  // 8 byte header
+  //   4 byte signature CGPH
+  //   1 byte version (1)
+  //   1 byte oid version (1 is sha1)
+  //   1 byte number of chunks
+  //   1 byte number of base graphs (layers before this one)
+  // followed by the chunk table, as in the multi-pack-index
+  enum : off64_t {
+    kHeaderSize = 8,
+    kChunkEntrySize = 12,
+    // tree, two parents, generation and date
+    kCommitDataSize = 20 + 4 + 4 + 8,
+  };
+
+  enum : uint32_t {
+    kOidFanout = 0x4f494446,  // OIDF, 256 x 4 byte fanout
+    kOidLookup = 0x4f49444c,  // OIDL, N x 20 byte sorted sha1s
+    kCommitData = 0x43444154, // CDAT, N x kCommitDataSize
+    kExtraEdges = 0x45444745, // EDGE, parents past the first of octopus merges
+    kNoParent = 0x70000000,
+    kMoreParents = 0x80000000,
+  };
+
+  struct Layer {
+    Layer(const std::string &file);
+    bool load(uint32_t base);
+    bool chunk(uint32_t id, off64_t &offset, off64_t &len);
+    uint32_t read32(off64_t offset);
+    uint32_t fanout(int n) { return read32(fanout_ + n*sizeof(uint32_t)); }
+
+    std::string file_name_;
+    MemoryMappedFile map_;
+    off64_t len_;
+    const uint8_t *addr_;
+    // positions before this layer
+    uint32_t base_;
+    uint32_t count_;
+    off64_t fanout_;
+    off64_t oids_;
+    off64_t data_;
+    off64_t edges_;
+    off64_t edges_len_;
+  };
+
+  // the layer pos is in, nullptr if it is out of bounds
+  Layer *layer(uint32_t pos);
+  bool addLayer(const std::string &file);
+
+  std::vector<std::unique_ptr<Layer> > layers_;
+  uint32_t count_;
+};
+
+}
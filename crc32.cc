@@ -0,0 +1,129 @@
+#include "zlib.h"
+#include "crc32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_PCLMUL_CRC32 1
+#endif
+
+namespace fusism {
+namespace {
+#if HAVE_PCLMUL_CRC32
+  // folds len bytes (a multiple of 16, at least 64) into the
+  // inverted crc, after "Fast CRC Computation for Generic Polynomials
+  // Using PCLMULQDQ Instruction" (Gopal et al, Intel), with the bit
+  // reflected constants of the crc32 polynomial from its appendix
+  __attribute__((target("pclmul,sse4.1")))
+  uint32_t foldCrc32(uint32_t crc, const uint8_t *buf, size_t len) {
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    buf += 64;
+    len -= 64;
+
+    // four lanes of 16 bytes folded in parallel
+    while (len >= 64) {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			 _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x00)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+			 _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x10)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+			 _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x20)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+			 _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + 0x30)));
+      buf += 64;
+      len -= 64;
+    }
+
+    // the four lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    __m128i lanes[] = { x2, x3, x4 };
+    for (auto lane : lanes) {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, lane), x5);
+    }
+
+    // what is left, 16 bytes at a time
+    while (len >= 16) {
+      x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf));
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+      buf += 16;
+      len -= 16;
+    }
+
+    // 128 bits down to 64
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // and a Barrett reduction down to 32
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return _mm_extract_epi32(x1, 1);
+  }
+
+  bool hasPclmul() {
+    static const bool has = __builtin_cpu_supports("pclmul") &&
+      __builtin_cpu_supports("sse4.1");
+    return has;
+  }
+#endif
+}
+
+  uint32_t Crc32::update(uint32_t crc, const uint8_t *data, size_t len) {
+#if HAVE_PCLMUL_CRC32
+    // below that the setup costs more than it saves
+    if (len >= 64 && hasPclmul()) {
+      size_t folded = len & ~(size_t)15;
+      crc = ~foldCrc32(~crc, data, folded);
+      data += folded;
+      len -= folded;
+    }
+#endif
+    // zlib takes uInt lengths
+    while (len > 0) {
+      uInt n = len > (1U << 30) ? (1U << 30) : len;
+      crc = ::crc32(crc, data, n);
+      data += n;
+      len -= n;
+    }
+    return crc;
+  }
+
+  bool Crc32::accelerated() {
+#if HAVE_PCLMUL_CRC32
+    return hasPclmul();
+#else
+    return false;
+#endif
+  }
+}
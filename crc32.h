@@ -0,0 +1,15 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+
+namespace fusism {
+  // the zlib crc32 (as in the idx crc32 table). on x86 with pclmulqdq
+  // long inputs are folded 64 bytes at a time with carry-less
+  // multiplies, the rest goes through zlib
+  struct Crc32 {
+    // crc is the crc32 so far, 0 to start with
+    static uint32_t update(uint32_t crc, const uint8_t *data, size_t len);
+    // true if the carry-less multiply path is in use
+    static bool accelerated();
+  };
+}
@@ -0,0 +1,48 @@
+#include "delta-base-cache.h"
+
+namespace fusism {
+  DeltaBaseCache::DeltaBaseCache(size_t limit) : limit_(limit),
+						 size_(0) { }
+
+  DeltaBaseCache::Object DeltaBaseCache::get(Pack pack, off64_t offset, int &type) {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = index_.find(Key{pack, offset});
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    type = it->second->type;
+    return it->second->object;
+  }
+
+  void DeltaBaseCache::put(Pack pack, off64_t offset, int type, const Object &object) {
+    if (object == nullptr || object->size() > limit_) {
+      return;
+    }
+    Key key = { pack, offset };
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+    }
+    lru_.push_front(Entry{key, type, object});
+    index_[key] = lru_.begin();
+    size_ += object->size();
+    evict();
+  }
+
+  size_t DeltaBaseCache::size() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return size_;
+  }
+
+  void DeltaBaseCache::evict() {
+    while (size_ > limit_ && !lru_.empty()) {
+      Entry &victim = lru_.back();
+      size_ -= victim.object->size();
+      index_.erase(victim.key);
+      lru_.pop_back();
+    }
+  }
+}
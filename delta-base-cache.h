@@ -0,0 +1,70 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fusism {
+  // size bounded LRU cache of reconstructed delta bases, keyed by
+  // their pack and entry offset in it. walking a delta chain caches
+  // every base on the way, so the next object deltified against the
+  // same base (or a later link of the chain) doesn't inflate it again.
+  // one cache is shared by all the packs of a repository, the limit
+  // is for all of them as git's is.
+  // thread safe, the cached objects are immutable and shared
+  struct DeltaBaseCache {
+    typedef std::shared_ptr<const std::vector<uint8_t> > Object;
+    // whatever tells the packs apart, their reader
+    typedef const void *Pack;
+
+    enum : size_t {
+      // same as git's core.deltaBaseCacheLimit
+      kDefaultLimit = 96 << 20,
+    };
+
+    DeltaBaseCache(size_t limit=kDefaultLimit);
+    // returns the cached object at offset in pack (and its type)
+    // or nullptr
+    Object get(Pack pack, off64_t offset, int &type);
+    // objects larger than the limit are not cached
+    void put(Pack pack, off64_t offset, int type, const Object &object);
+    size_t size();
+  private:
+    DeltaBaseCache(const DeltaBaseCache&);
+    DeltaBaseCache& operator=(const DeltaBaseCache&);
+
+    struct Key {
+      Pack pack;
+      off64_t offset;
+      bool operator==(const Key &o) const {
+	return pack == o.pack && offset == o.offset;
+      }
+    };
+
+    struct KeyHash {
+      size_t operator()(const Key &k) const {
+	return std::hash<uint64_t>()((uint64_t)(uintptr_t)k.pack ^
+				     ((uint64_t)k.offset << 16));
+      }
+    };
+
+    struct Entry {
+      Key key;
+      int type;
+      Object object;
+    };
+
+    // must be called with lock_ held
+    void evict();
+
+    std::mutex lock_;
+    // most recently used first
+    std::list<Entry> lru_;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    size_t limit_;
+    size_t size_;
+  };
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string.h>
+
+#include <algorithm>
+
+#include "delta-patcher.h"
+
+namespace fusism {
+  DeltaPatcher::DeltaPatcher(const uint8_t *delta,
+			     size_t len) : delta_(delta),
+					   len_(len),
+					   cursor_(0),
+					   base_size_(0),
+					   result_size_(0),
+					   valid_(false) {
+    valid_ = varint(base_size_) && varint(result_size_);
+  }
+
+  bool DeltaPatcher::varint(uint64_t &v) {
+    v = 0;
+    int sh = 0;
+    uint8_t byte;
+    do {
+      if (cursor_ >= len_ || sh > 63) return false;
+      byte = delta_[cursor_++];
+      v |= (uint64_t)(byte & 0x7f) << sh;
+      sh += 7;
+    } while (byte & 0x80);
+    return true;
+  }
+
+  ssize_t DeltaPatcher::apply(const uint8_t *base, size_t base_len,
+			      std::vector<uint8_t> &out) {
+    if (!valid_ || base_len != base_size_) {
+      std::cerr << "delta does not match its base\n";
+      return -1;
+    }
+    // every instruction takes a byte at least and copies no more
+    // than the base (or 0x10000 when it is smaller), a larger result
+    // can't come out of this delta. checked before the allocation,
+    // the size is as corrupt as the rest then
+    uint64_t per_op = std::max<uint64_t>(std::min<uint64_t>(base_len, 0xffffff), 0x10000);
+    if (result_size_ / per_op > len_ - cursor_) {
+      std::cerr << "delta result larger than the delta can make\n";
+      return -1;
+    }
+    out.resize(result_size_);
+    uint8_t *dst = out.data();
+    size_t written = 0;
+    size_t cursor = cursor_;
+    while (cursor < len_) {
+      uint8_t op = delta_[cursor++];
+      if (op & 0x80) {
+	// copy from base
+	uint64_t offset = 0, size = 0;
+	for (int i=0; i<4; i++) {
+	  if (op & (1 << i)) {
+	    if (cursor >= len_) return -1;
+	    offset |= (uint64_t)delta_[cursor++] << (8*i);
+	  }
+	}
+	for (int i=0; i<3; i++) {
+	  if (op & (0x10 << i)) {
+	    if (cursor >= len_) return -1;
+	    size |= (uint64_t)delta_[cursor++] << (8*i);
+	  }
+	}
+	if (size == 0) size = 0x10000;
+	if (offset + size > base_len || size > result_size_ - written) {
+	  std::cerr << "delta copy out of bounds\n";
+	  return -1;
+	}
+	memcpy(dst + written, base + offset, size);
+	written += size;
+      } else if (op) {
+	// insert op bytes from the delta itself
+	if (op > len_ - cursor || op > result_size_ - written) {
+	  std::cerr << "delta insert out of bounds\n";
+	  return -1;
+	}
+	memcpy(dst + written, delta_ + cursor, op);
+	cursor += op;
+	written += op;
+      } else {
+	std::cerr << "unexpected delta opcode 0\n";
+	return -1;
+      }
+    }
+    if (written != result_size_) {
+      std::cerr << "delta result size mismatch\n";
+      return -1;
+    }
+    return written;
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <vector>
+
+namespace fusism {
+  // applies a git delta (the inflated contents of an OFS_DELTA or
+  // REF_DELTA pack entry) to its base object.
+  // the delta starts with the base and result sizes as little endian
+  // base 128 varints, followed by instructions
+  //   1xxxxxxx copy from base, bits 0-3 flag which offset bytes follow,
+  //            bits 4-6 which size bytes follow (size 0 means 0x10000)
+  //   0nnnnnnn insert the next n bytes of the delta (n > 0)
+  struct DeltaPatcher {
+    DeltaPatcher(const uint8_t *delta, size_t len);
+    // false if the delta header is corrupt
+    bool valid() { return valid_; }
+    uint64_t baseSize() { return base_size_; }
+    uint64_t resultSize() { return result_size_; }
+    // writes base patched by the delta into out.
+    // returns the result size or -1 if the delta does not apply
+    ssize_t apply(const uint8_t *base, size_t base_len,
+		  std::vector<uint8_t> &out);
+  private:
+    bool varint(uint64_t &v);
+
+    const uint8_t *delta_;
+    size_t len_;
+    size_t cursor_;
+    uint64_t base_size_;
+    uint64_t result_size_;
+    bool valid_;
+  };
+}
@@ -13,15 +13,9 @@
 #include <string>
 #include <memory>
 
-std::string hexdump(uint8_t arr[], uint32_t len) {
-  std::string s;
-  for (uint32_t i=0; i<len; i++) {
-    char buf[3]={'.','.','.'};
-    sprintf(buf, "%02x", arr[i]);
-    s.append(buf);
-  }
-  return s;
-}
+#include "object-id.h"
+
+using ObjectId = fusism::ObjectId;
 
 // based off https://github.com/git/git/blob/master/Documentation/technical/index-format.txt
 // supports version 2 for now.
@@ -97,8 +91,7 @@ void git_index_read(unsigned char *addr, int len) {
     cursor += 4;
     file_size = ntohl(file_size);
 
-    uint8_t sha1[21]={0};
-    memcpy(&sha1, addr + cursor, 20);
+    ObjectId sha1 = ObjectId::fromRaw(addr + cursor);
     cursor += 20;
 
     uint16_t flags;
@@ -112,7 +105,7 @@ void git_index_read(unsigned char *addr, int len) {
     file_path[file_len]='\0';
     cursor += file_len;
     std::cerr << type << " "
-	      << hexdump(sha1, sizeof(sha1)-1) << " "
+	      << sha1.hex() << " "
       //	      << inode <<  " "
 	      << file_path << " "
 	      << file_size << "\n";
@@ -166,12 +159,11 @@ void git_index_read(unsigned char *addr, int len) {
     cursor += j+1;
     ext_i += j+1;
 
-    uint8_t sha1[21] = {0};
-    memcpy(&sha1[0], addr + cursor, 20);
+    ObjectId sha1 = ObjectId::fromRaw(addr + cursor);
     cursor += 20;
     ext_i += 20;
     std::cerr << num_entries << " " << num_sub_tress <<
-      " (" << path << ") " << hexdump(sha1, 20) << "\n";
+      " (" << path << ") " << sha1.hex() << "\n";
     free(path);
     free(entries);
     free(subtrees);
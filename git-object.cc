@@ -0,0 +1,121 @@
+#include <cassert>
+#include <iostream>
+#include <string.h>
+
+#include "git-object.h"
+#include "object-id.h"
+
+namespace fusism {
+
+std::string typeToStr(obj_type_t t) {
+  switch (t) {
+  case OBJ_NONE:
+    return "none";
+  case OBJ_COMMIT:
+    return "commit";
+  case OBJ_TREE:
+    return "tree";
+  case OBJ_BLOB:
+    return "blob";
+  case OBJ_TAG :
+    return "tag";
+  case OBJ_OFS_DELTA:
+    return "ofs delta";
+  case OBJ_REF_DELTA:
+    return "ref delta";
+  default:
+    std::cerr << "unknown type\n";
+    assert(0);
+    break;
+  }
+  return "";
+}
+
+obj_type_t strToType(const char *s, size_t len) {
+  static const obj_type_t types[] = { OBJ_COMMIT, OBJ_TREE, OBJ_BLOB, OBJ_TAG };
+  for (auto t : types) {
+    std::string name = typeToStr(t);
+    if (name.size() == len && !memcmp(name.data(), s, len)) {
+      return t;
+    }
+  }
+  return OBJ_NONE;
+}
+
+void printTree(const uint8_t *data, off64_t size, OutputBuffer &out) {
+  off64_t cursor = 0;
+  while (cursor < size) {
+    // skip permission
+    const void *sp = memchr(data + cursor, ' ', size - cursor);
+    if (sp == nullptr) break;
+    // skip space as well
+    cursor = static_cast<const uint8_t *>(sp) - data + 1;
+    const void *nul = memchr(data + cursor, '\0', size - cursor);
+    if (nul == nullptr) break;
+    off64_t name_end = static_cast<const uint8_t *>(nul) - data;
+    const uint8_t *name = data + cursor;
+    cursor = name_end + 1; // skip NUL as well
+    if (size - cursor < 20) break;
+    out.write(name, name_end - (name - data));
+    out.write(" ");
+    out.write(ObjectId::fromRaw(data + cursor).hex().c_str());
+    out.write("\n");
+    cursor += 20;
+  }
+}
+
+namespace {
+  bool headerId(const char *key, const uint8_t *data, off64_t size,
+		ObjectId &id) {
+    size_t len = strlen(key);
+    if (size < (off64_t)(len + 1 + ObjectId::kHexSize) ||
+	memcmp(data, key, len) || data[len] != ' ') {
+      return false;
+    }
+    return ObjectId::fromHex(reinterpret_cast<const char *>(data + len + 1),
+			     id, false);
+  }
+}
+
+bool commitTree(const uint8_t *data, off64_t size, ObjectId &tree) {
+  return headerId("tree", data, size, tree);
+}
+
+bool parseCommit(const uint8_t *data, off64_t size, ObjectId &tree,
+		 std::vector<ObjectId> &parents, int64_t &date) {
+  parents.clear();
+  date = 0;
+  if (!commitTree(data, size, tree)) {
+    return false;
+  }
+  // header lines up to the empty one before the message
+  const uint8_t *p = data;
+  const uint8_t *end = data + size;
+  while (p < end && *p != '\n') {
+    const uint8_t *eol = static_cast<const uint8_t *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    ObjectId parent;
+    if (headerId("parent", p, eol - p, parent)) {
+      parents.push_back(parent);
+    } else if (eol - p > 10 && !memcmp(p, "committer ", 10)) {
+      // committer Name <email> 1234567890 +0200
+      const uint8_t *gt = p;
+      for (const uint8_t *q = p; q < eol; q++) {
+	if (*q == '>') gt = q;
+      }
+      const uint8_t *q = gt + 1;
+      while (q < eol && *q == ' ') q++;
+      for (; q < eol && *q >= '0' && *q <= '9'; q++) {
+	date = date*10 + (*q - '0');
+      }
+    }
+    p = eol + 1;
+  }
+  return true;
+}
+
+bool tagObject(const uint8_t *data, off64_t size, ObjectId &object) {
+  return headerId("object", data, size, object);
+}
+
+} //namespace fusism
@@ -0,0 +1,45 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "object-id.h"
+#include "output-buffer.h"
+
+namespace fusism {
+  // object types as encoded in pack entry headers
+  typedef enum {
+    OBJ_NONE,
+    OBJ_COMMIT,
+    OBJ_TREE,
+    OBJ_BLOB,
+    OBJ_TAG,
+    OBJ_FUTURE,
+    OBJ_OFS_DELTA,
+    OBJ_REF_DELTA
+  } obj_type_t;
+
+  std::string typeToStr(obj_type_t t);
+  // type from the name used in loose object headers, OBJ_NONE if unknown
+  obj_type_t strToType(const char *s, size_t len);
+
+  // writes the entries of an inflated tree object to out.
+  // each entry is
+  // 6 bytes permission (e.g 100644)
+  // 1 byte space (0x20)
+  // NUL terminated path name (e.g 616c6c6f6376312e6300)
+  // 20 byte sha1 (e.g c4d5514e3a9fe3ee04d3d12d89eecf5a8eac3ebb)
+  void printTree(const uint8_t *data, off64_t size, OutputBuffer &out);
+
+  // the tree of an inflated commit, from its first line
+  // "tree <40 hex digits>"
+  bool commitTree(const uint8_t *data, off64_t size, ObjectId &tree);
+  // tree, parents (in order) and committer time of an inflated
+  // commit, from its header lines
+  bool parseCommit(const uint8_t *data, off64_t size, ObjectId &tree,
+		   std::vector<ObjectId> &parents, int64_t &date);
+  // the object an inflated annotated tag points at, from its
+  // first line "object <40 hex digits>"
+  bool tagObject(const uint8_t *data, off64_t size, ObjectId &object);
+}
@@ -1,552 +1,271 @@
 // git parser
-//   searches a given sha1 in the pack file (if available)
-//   or if there is a obj entry corresponding to the the file
-//   supports only the undeltified representation for now
+//   searches a given sha1 (or <rev>:<path>, e.g HEAD:Makefile) in all
+//   the pack files of the repository and in the loose objects
+//   resolves OFS_DELTA and REF_DELTA chains within the pack
 //
 //   use: git fetch-pack -k --thin --depth=10 -v git@github.com:torvalds/linux.git HEAD
 //   use this program to open a single file instead of cloning the entire git project
-// on https://github.com/git/git/blob/master/Documentation/technical/pack-format.txt
-// opens the idx file first and searches for the corresponding pack file
-
 // zlib decoder based off http://zlib.net/zlib_how.html
-// shoutout to Ben Hoyt's explanation of the pack encoding scheme
-// at https://github.com/benhoyt/pygit/blob/master/pygit.py#L441
 
-#include <cassert>
 #include <iostream>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/fcntl.h>
 #include <unistd.h>
 #include <string.h>
-#include <stdio.h>
-#include <sys/types.h>
-#include <stdint.h>
 #include <stdlib.h>
-#include <arpa/inet.h>
 
-#include <fstream>
-#include <functional>
-#include <algorithm>
+#include <atomic>
+#include <string>
 #include <vector>
-#include <iomanip>
 
-#include "z-file-inflater.h"
-#include "zlib.h"
-#include "memory-mapped-file.h"
-#include "utils.h"
+#include "batch-cat.h"
+#include "commit-graph.h"
+#include "git-object.h"
+#include "object-database.h"
+#include "object-id.h"
+#include "output-buffer.h"
+#include "path-resolver.h"
+#include "rev-walk.h"
+#include "tree-cache.h"
+#include "tree-diff.h"
+#include "tree-exporter.h"
+#include "tree-grep.h"
+
+using BatchCat = fusism::BatchCat;
+using CommitGraph = fusism::CommitGraph;
+using ObjectDatabase = fusism::ObjectDatabase;
+using ObjectId = fusism::ObjectId;
+using OutputBuffer = fusism::OutputBuffer;
+using PathResolver = fusism::PathResolver;
+using Prefetcher = fusism::Prefetcher;
+using RevWalk = fusism::RevWalk;
+using TreeDiff = fusism::TreeDiff;
+using TreeExporter = fusism::TreeExporter;
+using TreeGrep = fusism::TreeGrep;
+using obj_type_t = fusism::obj_type_t;
 
-typedef enum {
-  OBJ_NONE,
-  OBJ_COMMIT,
-  OBJ_TREE,
-  OBJ_BLOB,
-  OBJ_TAG,
-  OBJ_FUTURE,
-  OBJ_OFS_DELTA,
-  OBJ_REF_DELTA
-} obj_type_t;
+void usage() {
+  std::cerr << "pack-reader sha1|<rev>:<path>\n";
+  std::cerr << "\t writes the object to stdout\n";
+  std::cerr << "pack-reader --decode-all [threads]\n";
+  std::cerr << "\t decodes every object of the pack in parallel\n";
+  std::cerr << "pack-reader --verify [threads]\n";
+  std::cerr << "\t checks every pack against its idx: trailer checksums,\n";
+  std::cerr << "\t crc32 of every entry and sha1 of every object\n";
+  std::cerr << "pack-reader --batch [threads [io_uring|readahead|none]]\n";
+  std::cerr << "\t reads sha1s from stdin, one per line, and writes\n";
+  std::cerr << "\t <sha1> <type> <size>\\n<contents>\\n for each to stdout\n";
+  std::cerr << "\t in input order, looked up on threads in parallel.\n";
+  std::cerr << "\t pack data is read ahead with io_uring (or readahead)\n";
+  std::cerr << "pack-reader --export <rev>[:<path>] <dir> [threads [prefix...]]\n";
+  std::cerr << "\t writes the files of a tree under dir in parallel,\n";
+  std::cerr << "\t only the paths under the prefixes if any are given\n";
+  std::cerr << "pack-reader --diff <rev> <rev>\n";
+  std::cerr << "\t lists the paths that differ between two trees as\n";
+  std::cerr << "\t A|D|M|T <tab> path, like git diff-tree -r --name-status\n";
+  std::cerr << "pack-reader --grep <string> <rev>[:<path>] [threads]\n";
+  std::cerr << "\t prints path:line number:line for every line of the tree\n";
+  std::cerr << "\t containing string, blobs are searched in parallel\n";
+  std::cerr << "pack-reader --log <rev> [count [path]]\n";
+  std::cerr << "\t prints the sha1s of the commits reachable from rev,\n";
+  std::cerr << "\t newest first, only the ones changing path if given\n";
+  std::cerr << "\t (git rev-list rev -- path). count 0 is all of them\n";
+  std::cerr << "\t assumes a .git exists in the path to root\n";
+}
 
-std::string typeToStr(obj_type_t t) {
-  switch (t) {
-  case OBJ_NONE:
-    return "none";
-  case OBJ_COMMIT:
-    return "commit";
-  case OBJ_TREE:
-    return "tree";
-  case OBJ_BLOB:
-    return "blob";
-  case OBJ_TAG :
-    return "tag";
-  case OBJ_OFS_DELTA:
-    return "ofs delta";
-  case OBJ_REF_DELTA:
-    return "ref delta";
-  default:
-    std::cerr << "unknown type\n";
-    assert(0);
-    break;
+std::string find_git() {
+  char *p = getcwd(NULL, 0);
+  std::string s = p;
+  free(p);
+  while (s != "") {
+    auto gp = s+"/.git";
+    std::cerr << gp << "\n";
+    if (access(gp.c_str(), F_OK) == 0) {
+      return gp;
+    }
+    s = s.substr(0, s.rfind('/'));
   }
   return "";
 }
 
-using MemoryMappedFile = fusism::MemoryMappedFile;
-using ZFileInflater = fusism::ZFileInflater;
-
-struct PackIdxReader {
-  PackIdxReader(std::string file) : file_name_(file),
-			      addr_ (nullptr),
-			      len_(0),
-			      fd_(-1),
-			      cursor_(0),
-			      init_check_(false),
-			      packed_fd_(-1) {
-    int fd = open(file_name_.c_str(), O_RDONLY);
-    if (fd < 0) {
-      perror("open");
-      return;
-    }
-    struct stat sb;
-    if (fstat(fd, &sb) < 0) {
-      perror("stat");
-      return;
-    }
-    uint8_t *addr = (uint8_t *)mmap(NULL,
-				    sb.st_size,
-				    PROT_READ,
-				    MAP_PRIVATE,
-				    fd, 0);
-    if (addr == MAP_FAILED) {
-      perror("mmap");
-      return;
-    }
-
-    addr_ = addr;
-    fd_ = fd;
-    len_ = sb.st_size;
-
-    char magic[5] = {0};
-    readBytes(&magic, 4);
-    if (strcmp(magic, "\377tOc")) {
-      std::cerr << "not an idx file\n";
-      return;
-    }
-
-    uint32_t version;
-    readBytes(&version, sizeof(version));
-    version = ntohl(version);
-    if (version != 2) {
-      std::cerr << "version > 2 unsupported" << "\n";
-      return;
-    }
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    exit(-1);
+  }
 
-    if (setupPackedFd() < 0) {
-      std::cerr << "no companion pack file found\n";
-      return;
-    }
+  std::string git_path = find_git();
+  if (git_path == "") {
+    std::cerr << "no git found in path /\n";
+    return -1;
+  }
 
-    populate();
+  ObjectDatabase odb(git_path);
+  if (!odb.valid()) {
+    // answers would be wrong for everything in the missing pack
+    std::cerr << "cannot open every pack of " << git_path << "\n";
+    return -1;
   }
 
-  void cat(const char *sha1) {
-    if (!init_check_) {
-      std::cerr << "init_check failed" << "\n";
-      return;
+  if (!strcmp(argv[1], "--decode-all")) {
+    if (odb.packs().empty()) {
+      std::cerr << "no pack found\n";
+      return -1;
     }
-
-    auto po_it = std::find_if(pack_objects_.begin(),
-			      pack_objects_.end(),
-			      [&](PackObject &po) -> bool {
-				return po.sha1() == sha1;
-			      });
-    if (po_it == pack_objects_.end()) {
-      std::cerr << fusism::hexdump(reinterpret_cast<const uint8_t *>(sha1),
-				   strlen(sha1))  << " not found\n";
-      return;
+    unsigned threads = argc > 2 ? atoi(argv[2]) : 0;
+    std::atomic<uint64_t> counts[fusism::OBJ_REF_DELTA+1];
+    for (auto &c : counts) c = 0;
+    uint32_t failed = 0;
+    for (auto &reader : odb.packs()) {
+      failed += reader->decodeAll(threads,
+	[&](uint32_t, obj_type_t type, const std::vector<uint8_t> &) {
+	  counts[type] += 1;
+	});
     }
-    switch ((*po_it).type()) {
-    case OBJ_BLOB:
-      catBlob((*po_it).offset(), (*po_it).size());
-      break;
-    case OBJ_COMMIT:
-      catCommitTree((*po_it).offset(), (*po_it).size());
-      break;
-    case OBJ_TREE:
-      catTree((*po_it).offset(), (*po_it).size());
-      break;
-    case OBJ_REF_DELTA:
-      std::cerr << "ref delta\n";
-      break;
-    case OBJ_OFS_DELTA:
-      catOfsDelta((*po_it).offset(), (*po_it).size());
-      break;
-    default:
-      std::cerr << "unknown type " << (*po_it).type() << "\n";
-      break;
+    for (int t=fusism::OBJ_COMMIT; t<=fusism::OBJ_TAG; t++) {
+      std::cerr << fusism::typeToStr((obj_type_t)t) << " " << counts[t] << "\n";
     }
+    std::cerr << "failed " << failed << "\n";
+    return failed == 0 ? 0 : -1;
   }
 
-  int list() {
-    if (!init_check_) {
-      std::cerr << "init_check failed" << "\n";
+  if (!strcmp(argv[1], "--verify")) {
+    if (odb.packs().empty()) {
+      std::cerr << "no pack found\n";
       return -1;
     }
-
-    for (auto &po : pack_objects_) {
-      std::cerr << po.sha1()
-		<< " "
-		<< std::setw(8) << po.size()
-		<< " "
-		<< typeToStr(po.type())
-		<< "\n";
+    unsigned threads = argc > 2 ? atoi(argv[2]) : 0;
+    uint32_t problems = 0;
+    for (auto &reader : odb.packs()) {
+      uint32_t p = reader->verify(threads);
+      std::cerr << reader->name() << (p == 0 ? " ok" : " bad") << "\n";
+      problems += p;
     }
+    return problems == 0 ? 0 : -1;
   }
 
-  ~PackIdxReader( ) {
-    if (addr_) {
-      munmap(addr_, len_);
-    }
-    if (fd_ != -1) {
-      close(fd_);
-    }
-    if (packed_fd_ != -1) {
-      close(packed_fd_);
-    }
-  }
-  
-private:
-  struct PackObject {
-    PackObject(std::string sha1,
-	       obj_type_t t,
-	       off64_t offset,
-	       off64_t size) : sha1_(sha1),
-			       type_(t),
-			       offset_(offset),
-			       size_(size) { }
-    std::string sha1() { return sha1_; }
-    void update(std::function<uint8_t(void) > br) {
-      uint8_t byte = br();
-      type_ = (obj_type_t)((byte>>4)&0x7);
-      size_ = (byte&0xf); // 0TTTSSSS 1SSSSSS 0SSSSSSS
-      int32_t sh=4;
-      bool cont = byte&0x80;
-      while (cont) {
-	byte = br();
-	size_ |= ((byte&0x7f)<<sh);
-	sh += 7;
-	cont = (byte & 0x80);
+  if (!strcmp(argv[1], "--batch")) {
+    unsigned threads = argc > 2 ? atoi(argv[2]) : 0;
+    Prefetcher::Backend prefetch = Prefetcher::kAuto;
+    for (int b=Prefetcher::kIoUring; argc > 3 && b<=Prefetcher::kNone; b++) {
+      if (!strcmp(argv[3], Prefetcher::backendName((Prefetcher::Backend)b))) {
+	prefetch = (Prefetcher::Backend)b;
       }
     }
-    off64_t offset() { return offset_; }
-    obj_type_t type() { return type_; }
-    off64_t size() { return size_; }
-    void setOffset(off64_t o) { offset_ = o; }
-    void setSize(off64_t size) { size_ = size; }
-    void setType(obj_type_t t) { type_ = t; }
-
-  private:
-    std::string sha1_;
-    off64_t offset_;
-    off64_t size_;
-    obj_type_t type_;
-  };
-
-  ssize_t populate() {
-    // skip over to end of fan out table
-    // last element has total num of objects
-    forward(255*sizeof(uint32_t));
-
-    uint32_t entries;
-    readBytes(&entries, sizeof(entries));
-    entries = ntohl(entries);
+    // like git, missing objects are part of the answer, not an error
+    int64_t unreadable = BatchCat(odb, STDIN_FILENO, STDOUT_FILENO, threads,
+				  prefetch).run();
+    return unreadable == 0 ? 0 : -1;
+  }
 
-    std::cerr << entries << "\n";
-    for (uint32_t i=0; i<entries; ++i) {
-      uint8_t sha1[21] = {0};
-      readBytes(&sha1[0], 20);
-#if DEBUG
-      std::cerr << fusism::hexdump(sha1, 20) << "\n";
-#endif
-      pack_objects_.emplace_back(fusism::hexdump(sha1, 20),
-				 OBJ_NONE,
-				 0,
-				 -1);
+  ObjectId id;
+  uint32_t mode;
+  fusism::TreeCache trees;
+  if (!strcmp(argv[1], "--export")) {
+    if (argc < 4) {
+      usage();
+      return -1;
     }
-
-    // skip over the table of 4-byte crc32 values
-    forward(entries*sizeof(uint32_t));
-
-    for (uint32_t i=0; i<entries; ++i) {
-      uint32_t offset;
-      readBytes(&offset, sizeof(offset));
-      offset = ntohl(offset);
-      if (offset & 0x80000000) {
-	// this is an index into the next table, ignore for now
-	std::cerr << "ignore large file offsets\n";
-	continue;
-      }
-      if (offset == 246) {
-	std::cerr << "add entry at offset " << offset << "\n";
-      }
-      lseek64(packed_fd_, offset, SEEK_SET);
-      pack_objects_[i].update([=](void) -> uint8_t {
-	uint8_t byte;
-	read(packed_fd_, &byte, 1);
-	return byte;
-	});
-      pack_objects_[i].setOffset(lseek64(packed_fd_, 0, SEEK_CUR));
-#if DEBUG
-      std::cerr << offset <<"\n";
-#endif
+    if (!ObjectId::fromHex(argv[2], id) &&
+	!PathResolver(odb, trees).resolve(argv[2], id, mode)) {
+      std::cerr << argv[2] << " cannot be resolved\n";
+      return -1;
     }
-
-    std::cerr << "file looks good\n";
-    init_check_ = true;
-  }
-
-  void catBlob(off64_t offset, off64_t size) {
-    MemoryMappedFile out(ZFileInflater(packed_fd_,
-				       offset,
-				       size).inflate());
-    if (!out.valid()) return;
-    off64_t cursor = 0;
-    while (cursor < size) {
-      std::cerr << out[cursor++];
+    TreeExporter exporter(odb, argv[3], argc > 4 ? atoi(argv[4]) : 0);
+    for (int i=5; i<argc; i++) {
+      exporter.addPrefix(argv[i]);
     }
-    std::cerr << "\n";
+    uint64_t failed = exporter.run(id);
+    std::cerr << exporter.files() << " files " << exporter.bytes() << " bytes\n";
+    std::cerr << "failed " << failed << "\n";
+    return failed == 0 ? 0 : -1;
   }
 
-  // offset in the pack file and uncompressed size
-  // as per the spec.
-  // after inflate, the format for the tree seems to be
-  // 6 bytes permission (e.g 100644)
-  // 1 byte space (0x20)
-  // NUL terminated path name (e.g 616c6c6f6376312e6300)
-  // 20 byte sha1 (e.g c4d5514e3a9fe3ee04d3d12d89eecf5a8eac3ebb)
-  // perhaps type of an object can be printed by checking the sha1
-  // with the pack objects
-  void catTree(off64_t offset, off64_t size) {
-    MemoryMappedFile out(ZFileInflater(packed_fd_, offset, size).inflate());
-    if (!out.valid()) return;
-    off64_t cursor = 0;
-    while (cursor < size) {
-      // skip permission
-      while (out[cursor] != ' ') ++cursor;
-      // skip space as well
-      cursor += 1;
-      while (out[cursor] != '\0') {
-	std::cerr << out[cursor];
-	cursor += 1;
-      }
-      cursor += 1; // skip NUL as well
-      std::cerr << " ";
-      std::cerr << out.dump(cursor, 20) << "\n";
-      cursor += 20;
+  if (!strcmp(argv[1], "--diff")) {
+    if (argc < 4) {
+      usage();
+      return -1;
     }
-  }
-
-  void catCommitTree(off64_t offset, off64_t size) {
-    MemoryMappedFile out(ZFileInflater(packed_fd_, offset, size).inflate());
-    if (!out.valid()) return;
-#if DEBUG
-    std::cerr << out.dump(0, size) << "\n";
-#endif
-    off64_t cursor = 0;
-    cursor += 4; // skip over TREE
-
-    cursor += 1; // skip over space
-
-    // next 40 chars contains the string
-    // representation of the 20 byte sha1
-    char sha1[41]={0};
-    for (uint32_t i=0; i<40; ++i) {
-      sha1[i] = out[cursor];
-      cursor+=1;
+    PathResolver resolver(odb, trees);
+    ObjectId a, b;
+    for (int i=2; i<4; i++) {
+      if (!ObjectId::fromHex(argv[i], i == 2 ? a : b) &&
+	  !resolver.resolve(argv[i], i == 2 ? a : b, mode)) {
+	std::cerr << argv[i] << " cannot be resolved\n";
+	return -1;
+      }
     }
-
-    return cat(&sha1[0]);
+    OutputBuffer out(STDOUT_FILENO);
+    bool ok = TreeDiff(resolver).diff(a, b, [&](const TreeDiff::Change &c) -> bool {
+	char status[2] = { (char)c.status, '\t' };
+	return out.write(status, 2) && out.write(c.path.data(), c.path.size()) &&
+	  out.write("\n");
+      });
+    return ok && out.flush() ? 0 : -1;
   }
 
-  void catOfsDelta(off64_t offset, off64_t size) {
-    MemoryMappedFile out(dup(packed_fd_));
-    if (!out.valid()) return;
-
-    off64_t cursor = offset;
-    uint8_t byte = out[cursor++];
-    off64_t delta_offset = (byte&0x7f); // 1SSSSSSS 1SSSSSS 0SSSSSSS
-    int32_t sh=4;
-    bool cont = byte&0x80;
-    while (cont) {
-      byte = out[cursor++];
-      delta_offset |= ((byte&0x7f)<<sh);
-      sh += 7;
-      cont = (byte&0x80);
+  if (!strcmp(argv[1], "--grep")) {
+    if (argc < 4 || argv[2][0] == '\0') {
+      usage();
+      return -1;
     }
-    std::cerr << size << " "
-	      << offset << " " << delta_offset << "\n";
-    return catBlob(cursor, size);
-  }
-
-  int setupPackedFd() {
-    int pos = file_name_.rfind(".idx");
-    if (pos == -1) {
-      std::cerr << "no idx file suffix found\n";
+    if (!ObjectId::fromHex(argv[3], id) &&
+	!PathResolver(odb, trees).resolve(argv[3], id, mode)) {
+      std::cerr << argv[3] << " cannot be resolved\n";
       return -1;
     }
-
-    std::string pack_str = file_name_.substr(0, pos) + ".pack";
-    packed_fd_ = open(pack_str.c_str(), O_RDONLY);
-    if (packed_fd_ < 0) {
-      std::cerr << "couldn't find pack string\n";
+    OutputBuffer out(STDOUT_FILENO);
+    int64_t matches = TreeGrep(odb, argv[2], out,
+			       argc > 4 ? atoi(argv[4]) : 0).run(id);
+    if (!out.flush() || matches < 0) {
       return -1;
     }
-    return 0;
-  }
-
-  ssize_t readBytes(void *bytes, off64_t num) {
-    assert(len_ - cursor_ > num);
-    memcpy(bytes, addr_ + cursor_, num);
-    cursor_ += num;
-    return num;
-  }
-
-  ssize_t seekTo(off64_t off) {
-    assert(0 <= off && off < len_);
-    cursor_ = off;
-  }
-
-  ssize_t rewind(off64_t num) {
-    assert(cursor_ >= num);
-    cursor_ -= num;
-    return 0;
-  }
-
-  ssize_t forward(off64_t num) {
-    assert(len_ - cursor_ > num);
-    cursor_ += num;
-    return 0;
+    // like grep, 1 if nothing was found
+    return matches > 0 ? 0 : 1;
   }
 
-private:
-  std::string file_name_;
-  off64_t cursor_;
-  int fd_;
-  off64_t len_;
-  uint8_t *addr_;
-  bool init_check_;
-  int packed_fd_;
-  std::vector<PackObject> pack_objects_;
-};
-
-void usage() {
-  std::cerr << "pack-reader sha1\n";
-  std::cerr << "\t assumes a .git exists in the path to root\n";
-}
-
-struct ObjectReader {
-  ObjectReader(std::string obj_path) :
-    path_(obj_path) {
-    fd_ = open(obj_path.c_str(), O_RDONLY);
-    struct stat sb;
-    if (fstat(fd_, &sb) == 0) {
-      size_ = sb.st_size;
+  if (!strcmp(argv[1], "--log")) {
+    if (argc < 3) {
+      usage();
+      return -1;
     }
-  }
-
-  ~ObjectReader() {
-    if (fd_ >= 0) {
-      close(fd_);
+    PathResolver resolver(odb, trees);
+    if (!ObjectId::fromHex(argv[2], id) && !resolver.resolve(argv[2], id, mode)) {
+      std::cerr << argv[2] << " cannot be resolved\n";
+      return -1;
     }
-  }
-
-  void cat() {
-    off64_t cursor = 0;
-    MemoryMappedFile out(ZFileInflater(fd_).inflate());
-    if (!out.valid()) return;
-
-    char type[5]={0};
-    for (int i=0; i<4; i++) type[i] = out[i];
-
-    if (!strcmp(type, "tree")) {
-      cursor += 4; // skip the size
-      cursor += 1; // skip the space
-      while (cursor < out.size()) {
-	// skip permission
-	while (out[cursor] != ' ') ++cursor;
-	// skip space as well
-	cursor += 1;
-	while (out[cursor] != '\0') {
-	  std::cerr << out[cursor];
-	  cursor += 1;
-	}
-	cursor += 1; // skip NUL as well
-	std::cerr << " ";
-	std::cerr << out.dump(cursor, 20) << "\n";
-	cursor += 20;
-      }
-    } else if (!strcmp(type, "blob")) {
-      cursor += 4; // skip the word
-      cursor += 1; // skip the space
-      cursor += 4; // skip the 32bit size
-      while (cursor < out.size()) {
-	std::cerr << out[cursor++];
-      }
-    } else {
-      std::cerr << "support for commit tree TBD\n";
+    uint64_t count = argc > 3 ? strtoull(argv[3], nullptr, 10) : 0;
+    CommitGraph graph(git_path);
+    RevWalk walk(odb, graph, resolver);
+    if (argc > 4) {
+      walk.limit(argv[4]);
     }
-  }
-private:
-  std::string path_;
-  int fd_;
-  off64_t size_;
-};
-
-std::string find_git() {
-  char *p = getcwd(NULL, 0);
-  std::string s = p;
-  free(p);
-  while (s != "") {
-    auto gp = s+"/.git";
-    std::cerr << gp << "\n";
-    if (access(gp.c_str(), F_OK) == 0) {
-      return gp;
+    if (!walk.push(id)) {
+      std::cerr << argv[2] << " is not a commit\n";
+      return -1;
     }
-    s = s.substr(0, s.rfind('/'));
-  }
-  return "";
-}
-
-std::string pack_file(std::string git_path) {
-  auto pack_info = git_path+"/objects/info/packs";
-  if (access(pack_info.c_str(),
-	     F_OK|R_OK) < 0) {
-    return "";
-  }
-  std::string line;
-  std::ifstream infile(pack_info);
-  std::getline(infile, line);
-  line = line.substr(line.find(' ')+1, line.find(".pack")-2);
-  return git_path+"/objects/pack/"+line+".idx";
-}
-
-std::string obj_file(std::string git_path,
-		     std::string sha1) {
-  auto obj_path = git_path + "/objects/" +
-                  sha1.substr(0,2) + "/" +
-                  sha1.substr(2);
-  std::cerr << obj_path << "\n";
-  if (access(obj_path.c_str(), F_OK|R_OK) < 0) {
-    return "";
-  }
-  return obj_path;
-}
-
-int main(int argc, char **argv)
-{
-  if (argc < 2) {
-    usage();
-    exit(-1);
+    OutputBuffer out(STDOUT_FILENO);
+    RevWalk::Commit c;
+    char line[ObjectId::kHexSize + 1];
+    line[ObjectId::kHexSize] = '\n';
+    for (uint64_t n=0; (count == 0 || n < count) && walk.next(c); n++) {
+      c.id.hex(line);
+      if (!out.write(line, sizeof(line))) break;
+    }
+    std::cerr << walk.fromGraph() << " commits from the commit-graph, "
+	      << walk.inflated() << " inflated\n";
+    return out.flush() ? 0 : -1;
   }
 
-  std::string git_path = find_git();
-  if (git_path == "") {
-    std::cerr << "no git found in path /\n";
+  if (!ObjectId::fromHex(argv[1], id) &&
+      !PathResolver(odb, trees).resolve(argv[1], id, mode)) {
+    std::cerr << argv[1] << " cannot be resolved\n";
     return -1;
   }
 
-  std::string pack;
-  std::string obj;
-  if ((pack=pack_file(git_path)) != "") {
-    PackIdxReader reader(pack);
-    // reader.list();
-    reader.cat(argv[1]);
-  } else if ((obj=obj_file(git_path, argv[1])) != "") {
-    // see if there is a path of the type
-    // git_path/b1b2/b3...b20
-    ObjectReader reader(obj);
-    reader.cat();
-  } else {
+  // contents on stdout, diagnostics stay on stderr
+  OutputBuffer out(STDOUT_FILENO);
+  if (!odb.cat(id, out) || !out.flush()) {
     std::cerr << argv[1] << " cannot be looked at\n";
+    return -1;
   }
 }
@@ -0,0 +1,137 @@
+// micro-benchmark of inflating small objects (trees, commits), where
+// the z_stream setup is a large part of the cost.
+//   inflate-bench [objects [rounds]]
+// compares a fresh inflateInit/inflateEnd per object against
+// ZFileInflater, whose streams come from the per thread pool
+
+#include <iostream>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+#include "memory-mapped-file.h"
+#include "z-file-inflater.h"
+
+using MemoryMappedFile = fusism::MemoryMappedFile;
+using ZFileInflater = fusism::ZFileInflater;
+
+namespace {
+  struct Object {
+    off64_t offset;
+    off64_t in_len;
+    off64_t size;
+  };
+
+  // a tree of a few entries, binary ids like the real ones
+  std::string tree(unsigned seed) {
+    std::string t;
+    for (unsigned e=0; e<8; e++) {
+      t += e % 3 ? "100644 " : "40000 ";
+      t += "file-" + std::to_string(seed) + "-" + std::to_string(e) + ".cc";
+      t += '\0';
+      for (int b=0; b<20; b++) t += (char)rand();
+    }
+    return t;
+  }
+
+  std::string commit(unsigned seed) {
+    char hex[41];
+    for (int i=0; i<40; i++) hex[i] = "0123456789abcdef"[rand() % 16];
+    hex[40] = '\0';
+    std::string c = std::string("tree ") + hex + "\nparent " + hex + "\n";
+    c += "author A U Thor <author@example.com> " + std::to_string(1500000000 + seed) + " +0000\n";
+    c += "committer A U Thor <author@example.com> " + std::to_string(1500000000 + seed) + " +0000\n";
+    c += "\nchange number " + std::to_string(seed) + "\n";
+    return c;
+  }
+
+  // writes the deflated objects to fd, returns where they are
+  std::vector<Object> write(int fd, unsigned count, std::string (*make)(unsigned)) {
+    std::vector<Object> objects;
+    off64_t pos = lseek(fd, 0, SEEK_END);
+    for (unsigned i=0; i<count; i++) {
+      std::string data = make(i);
+      uLongf len = compressBound(data.size());
+      std::vector<uint8_t> z(len);
+      compress(z.data(), &len, reinterpret_cast<const Bytef *>(data.data()), data.size());
+      if (::write(fd, z.data(), len) != (ssize_t)len) {
+	perror("write");
+	exit(-1);
+      }
+      objects.push_back(Object{pos, (off64_t)len, (off64_t)data.size()});
+      pos += len;
+    }
+    return objects;
+  }
+
+  // the way objects were inflated before the pool: a new stream,
+  // default allocator, for every object
+  bool plain(MemoryMappedFile &map, const Object &o, uint8_t *out) {
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    if (inflateInit(&s) != Z_OK) return false;
+    s.next_in = const_cast<uint8_t *>(map.span(o.offset, o.in_len));
+    s.avail_in = o.in_len;
+    s.next_out = out;
+    s.avail_out = o.size;
+    int ret = inflate(&s, Z_FINISH);
+    inflateEnd(&s);
+    return ret == Z_STREAM_END;
+  }
+
+  template<typename F>
+  double nsPerObject(const std::vector<Object> &objects, unsigned rounds, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r=0; r<rounds; r++) {
+      for (auto &o : objects) {
+	if (!f(o)) {
+	  std::cerr << "inflate failed\n";
+	  exit(-1);
+	}
+      }
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+    return (double)ns / (objects.size() * rounds);
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned count = argc > 1 ? atoi(argv[1]) : 10000;
+  unsigned rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+  char name[] = "/tmp/inflate-bench-XXXXXX";
+  int fd = mkstemp(name);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  unlink(name);
+  srand(1);
+  std::vector<Object> trees = write(fd, count, tree);
+  std::vector<Object> commits = write(fd, count, commit);
+  MemoryMappedFile map(fd, MemoryMappedFile::kWholeFile);
+
+  std::vector<uint8_t> out(4096);
+  struct Kind {
+    const char *name;
+    std::vector<Object> &objects;
+  } kinds[] = { { "tree", trees }, { "commit", commits } };
+  for (auto &k : kinds) {
+    double before = nsPerObject(k.objects, rounds, [&](const Object &o) {
+	return plain(map, o, out.data());
+      });
+    double pooled = nsPerObject(k.objects, rounds, [&](const Object &o) {
+	return ZFileInflater(map, o.offset, o.size, o.in_len).inflate(out.data(), o.size) == o.size;
+      });
+    printf("%-6s %5lld bytes  inflateInit/End %7.0f ns  pooled %7.0f ns  saved %5.0f ns\n",
+	   k.name, (long long)k.objects[0].size, before, pooled, before - pooled);
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "literal-matcher.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_SIMD_MATCHER 1
+#endif
+
+namespace fusism {
+namespace {
+#if HAVE_SIMD_MATCHER
+  // n is at least 2 bytes long. returns where the vector loop
+  // stopped in *stop when there is no match, the tail is left to
+  // the caller
+  const uint8_t *findSse2(const uint8_t *s, size_t len,
+			  const uint8_t *n, size_t n_len, size_t *stop) {
+    const __m128i first = _mm_set1_epi8(n[0]);
+    const __m128i last = _mm_set1_epi8(n[n_len - 1]);
+    size_t i = 0;
+    for (; i + n_len - 1 + 16 <= len; i += 16) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + n_len - 1));
+      unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+						      _mm_cmpeq_epi8(b, last)));
+      while (mask != 0) {
+	unsigned bit = __builtin_ctz(mask);
+	if (!memcmp(s + i + bit + 1, n + 1, n_len - 2)) {
+	  return s + i + bit;
+	}
+	mask &= mask - 1;
+      }
+    }
+    *stop = i;
+    return nullptr;
+  }
+
+  __attribute__((target("avx2")))
+  const uint8_t *findAvx2(const uint8_t *s, size_t len,
+			  const uint8_t *n, size_t n_len, size_t *stop) {
+    const __m256i first = _mm256_set1_epi8(n[0]);
+    const __m256i last = _mm256_set1_epi8(n[n_len - 1]);
+    size_t i = 0;
+    for (; i + n_len - 1 + 32 <= len; i += 32) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + n_len - 1));
+      unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+							    _mm256_cmpeq_epi8(b, last)));
+      while (mask != 0) {
+	unsigned bit = __builtin_ctz(mask);
+	if (!memcmp(s + i + bit + 1, n + 1, n_len - 2)) {
+	  return s + i + bit;
+	}
+	mask &= mask - 1;
+      }
+    }
+    *stop = i;
+    return nullptr;
+  }
+
+  bool hasAvx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+  }
+#endif
+}
+
+  LiteralMatcher::LiteralMatcher(const std::string &needle) : needle_(needle) { }
+
+  const uint8_t *LiteralMatcher::find(const uint8_t *begin, const uint8_t *end) const {
+    size_t len = end - begin;
+    const uint8_t *n = reinterpret_cast<const uint8_t *>(needle_.data());
+    size_t n_len = needle_.size();
+    if (n_len == 0) {
+      return begin;
+    }
+    if (n_len > len) {
+      return nullptr;
+    }
+    if (n_len == 1) {
+      return static_cast<const uint8_t *>(memchr(begin, n[0], len));
+    }
+#if HAVE_SIMD_MATCHER
+    size_t stop;
+    const uint8_t *m = hasAvx2() ? findAvx2(begin, len, n, n_len, &stop) :
+      findSse2(begin, len, n, n_len, &stop);
+    if (m != nullptr) {
+      return m;
+    }
+    begin += stop;
+    len -= stop;
+#endif
+    return static_cast<const uint8_t *>(memmem(begin, len, n, n_len));
+  }
+
+  const char *LiteralMatcher::accelerated() {
+#if HAVE_SIMD_MATCHER
+    return hasAvx2() ? "avx2" : "sse2";
+#else
+    return "none";
+#endif
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+
+namespace fusism {
+  // finds a fixed string in a buffer. on x86 16 (sse2) or 32 (avx2)
+  // positions are tested at once: a candidate needs both the first and
+  // the last byte of the needle in the right place, and only those
+  // are compared in full. the rest goes through memchr/memmem
+  struct LiteralMatcher {
+    LiteralMatcher(const std::string &needle);
+    // the first occurrence in [begin, end), nullptr if there is none
+    const uint8_t *find(const uint8_t *begin, const uint8_t *end) const;
+    const std::string &needle() const { return needle_; }
+    // "avx2", "sse2" or "none"
+    static const char *accelerated();
+  private:
+    std::string needle_;
+  };
+}
@@ -12,20 +12,41 @@
 
 namespace fusism {
 
-MemoryMappedFile::MemoryMappedFile(int fd) : fd_(fd) {
+MemoryMappedFile::MemoryMappedFile(int fd, off64_t window,
+				   bool own_fd) : fd_(fd),
+						  own_fd_(own_fd),
+						  size_(0),
+							     window_(window),
+							     key_(),
+							     map_(nullptr) {
     struct stat sb;
     if (fd_ >= 0) {
       fstat(fd_, &sb);
       size_ = sb.st_size;
-      remap(0);
+      key_.dev = sb.st_dev;
+      key_.ino = sb.st_ino;
+      key_.size = sb.st_size;
+      key_.mtime_ns = sb.st_mtim.tv_sec*1000000000LL + sb.st_mtim.tv_nsec;
+      if (size_ > 0) {
+	remap(0);
+      }
+      // the window stays referenced, nothing is ever mapped again
+      if (window_ == kWholeFile && map_ != nullptr) {
+	closeFd();
+      }
     }
 }
 
 MemoryMappedFile::~MemoryMappedFile() {
     unmap();
-    if (fd_ >= 0) {
-      close(fd_);
-    }
+    closeFd();
+}
+
+void MemoryMappedFile::closeFd() {
+  if (fd_ >= 0 && own_fd_) {
+    close(fd_);
+  }
+  fd_ = -1;
 }
 
 MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) {
@@ -34,79 +55,85 @@ MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) {
 
 MemoryMappedFile&
 MemoryMappedFile::operator=(MemoryMappedFile&& other) {
-  moveFrom(std::forward<MemoryMappedFile>(other));
+  if (this != &other) {
+    unmap();
+    closeFd();
+    moveFrom(std::forward<MemoryMappedFile>(other));
+  }
   return *this;
 }
 
 uint8_t MemoryMappedFile::operator[](off64_t offset) {
-  if (addr_ != NULL) {
-    if (offset < map_begin_ || offset >= (map_begin_ + map_len_)) {
-      remap(offset);
-    }
-    return addr_[offset-map_begin_];
+  const uint8_t *addr = span(offset, 1);
+  if (addr != nullptr) {
+    return *addr;
   }
   return '\0';
 }
 
+const uint8_t *MemoryMappedFile::span(off64_t offset, off64_t len) {
+  if (offset < 0 || len < 0 || offset > size_ || size_ - offset < len) {
+    return nullptr;
+  }
+  if (len == 0) {
+    // nothing to read, but hand out a non null pointer
+    return reinterpret_cast<const uint8_t *>("");
+  }
+  if (map_ == nullptr || !map_->covers(offset, len)) {
+    remap(offset, len);
+  }
+  if (map_ == nullptr) {
+    return nullptr;
+  }
+  return map_->addr + (offset - map_->begin);
+}
+
 std::string MemoryMappedFile::dump(off64_t offset, off64_t len) {
   if (size_ - offset < len) { //offset + len > size_) {
     std::cerr << offset << " " << len << " " << size_ << "\n";
     return "OUTOFBOUNDS";
   }
-  std::string s;
-  /*
-    AAAAAAAXXXXXX|XXXXXXXXXXXX|XXXXBBBBBBBB
-  */
-  while (len > 0) {
-    remap(offset);
-    off64_t o = offset - map_begin_;
-    uint8_t *addr = addr_ + o;
-    off64_t l = std::min(map_len_ - o, len);
-    s += hexdump(addr, l);
-    offset += map_len_;
-    len -= l;
+  const uint8_t *addr = span(offset, len);
+  if (addr == nullptr) {
+    return "OUTOFBOUNDS";
   }
-  assert(len == 0);
-  return s;
+  return hexdump(addr, len);
 }
 
 void MemoryMappedFile::unmap() {
-  if (addr_ != NULL) {
-    munmap(addr_, map_len_);
+  if (map_ != nullptr) {
+    PackWindowCache::instance().release(map_);
+    map_ = nullptr;
   }
 }
 
-void MemoryMappedFile::remap(off64_t offset) {
+void MemoryMappedFile::remap(off64_t offset, off64_t len) {
   assert(offset < size_);
   unmap();
-  // remap at page boundary before offset
-  long page_sz = sysconf(_SC_PAGESIZE);
-  off64_t nearest_page = (offset/page_sz)*page_sz;
-  map_begin_ = nearest_page;
-  map_len_ = ((size_-map_begin_) > page_sz) ? page_sz :
-                                (size_ - nearest_page);
-  addr_ = (uint8_t *)mmap(NULL,
-			  map_len_,
-			  PROT_READ|PROT_WRITE,
-			  MAP_PRIVATE,
-			  fd_, map_begin_);
-  if (addr_ == MAP_FAILED) {
-    perror("MMAP FAILED");
-    addr_ = nullptr;
+  off64_t window = window_;
+  if (window == kPageWindow) {
+    window = sysconf(_SC_PAGESIZE);
+  }
+  map_ = PackWindowCache::instance().acquire(key_, fd_,
+					     offset, len, window);
+  if (map_ == nullptr) {
+    std::cerr << "MMAP FAILED\n";
   }
 }
 
 void MemoryMappedFile::moveFrom(MemoryMappedFile &&other) {
   fd_ = -1;
+  own_fd_ = true;
   size_ = 0;
-  addr_ = NULL;
-  map_begin_ = 0;
-  map_len_ = 0;
+  window_ = kPageWindow;
+  key_ = PackWindowCache::FileKey();
+  map_ = nullptr;
   std::swap(fd_, other.fd_);
+  std::swap(own_fd_, other.own_fd_);
   std::swap(size_, other.size_);
-  std::swap(addr_, other.addr_);
-  std::swap(map_begin_, other.map_begin_);
-  std::swap(map_len_, other.map_len_);
+  std::swap(window_, other.window_);
+  std::swap(key_, other.key_);
+  std::swap(map_, other.map_);
 }
 
 } //namespace fusism
@@ -1,30 +1,56 @@
 #pragma once
 #include <string>
+#include "pack-window-cache.h"
 
 namespace fusism {
 
 struct MemoryMappedFile {
-  MemoryMappedFile(int fd);
+  // window sizes for the mapping. kPageWindow maps a single page
+  // around the accessed offset, kWholeFile maps the file once.
+  // any other positive value maps windows of (at least) that many bytes.
+  // kPackWindow is what pack files are read with.
+  // windows come from the process wide PackWindowCache, so files
+  // opened more than once share the same mappings
+  enum : off64_t {
+    kWholeFile = -1,
+    kPageWindow = 0,
+    kPackWindow = 32LL << 20,
+  };
+
+  // the fd is closed with the file if own_fd is set. a whole file
+  // mapping doesn't need it past the constructor, an owned fd is
+  // closed right away
+  MemoryMappedFile(int fd, off64_t window=kPageWindow, bool own_fd=true);
   ~MemoryMappedFile();
   MemoryMappedFile(MemoryMappedFile&& other);
   MemoryMappedFile& operator=(MemoryMappedFile&& other);
-  bool valid() { return fd_ >= 0; }
+  bool valid() { return fd_ >= 0 || map_ != nullptr; }
   uint8_t operator[](off64_t offset);
+  // returns a pointer to len contiguous bytes starting at offset,
+  // remapping the window to cover them if required.
+  // returns nullptr if [offset, offset+len) is out of bounds.
+  // the pointer is valid until the next access to this file
+  const uint8_t *span(off64_t offset, off64_t len);
   std::string dump(off64_t offset, off64_t len);
+  // lets go of the current window so the cache may evict it, the
+  // next access maps again
+  void release() { unmap(); }
   off64_t size() { return size_; }
 private:
   MemoryMappedFile(const MemoryMappedFile&);
   MemoryMappedFile& operator=(const MemoryMappedFile&);
 
   void unmap();
-  void remap(off64_t offset);
+  void remap(off64_t offset, off64_t len=1);
   void moveFrom(MemoryMappedFile &&other);
+  void closeFd();
 
   int fd_;
+  bool own_fd_;
   off64_t size_;
-  uint8_t *addr_;
-  off64_t map_begin_;
-  off64_t map_len_;
+  off64_t window_;
+  PackWindowCache::FileKey key_;
+  PackWindowCache::Window *map_;
 };
 
 }
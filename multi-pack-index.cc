@@ -0,0 +1,188 @@
+// on https://git-scm.com/docs/gitformat-pack#_multi_pack_index_midx_files_have_the_following_format
+
+#include <iostream>
+#include <sys/fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include <endian.h>
+
+#include "multi-pack-index.h"
+
+namespace fusism {
+
+MultiPackIndex::MultiPackIndex(std::string file) : file_name_(file),
+						   midx_(-1),
+						   len_(0),
+						   addr_(nullptr),
+						   init_check_(false),
+						   entries_(0),
+						   fanout_(-1),
+						   oids_(-1),
+						   offsets_(-1),
+						   large_offsets_(-1),
+						   large_len_(0) {
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  midx_ = MemoryMappedFile(fd, MemoryMappedFile::kWholeFile);
+  len_ = midx_.size();
+  addr_ = midx_.span(0, len_);
+  if (addr_ == nullptr || len_ < kHeaderSize) {
+    std::cerr << file_name_ << " mmap failed\n";
+    return;
+  }
+  if (memcmp(addr_, "MIDX", 4)) {
+    std::cerr << file_name_ << " not a multi-pack-index\n";
+    return;
+  }
+  if (addr_[4] != 1 || addr_[5] != 1) {
+    std::cerr << file_name_ << " unsupported version\n";
+    return;
+  }
+  if (addr_[7] != 0) {
+    std::cerr << file_name_ << " incremental multi-pack-index unsupported\n";
+    return;
+  }
+  populate();
+}
+
+uint32_t MultiPackIndex::read32(off64_t offset) {
+  uint32_t v;
+  memcpy(&v, addr_ + offset, sizeof(v));
+  return ntohl(v);
+}
+
+bool MultiPackIndex::chunk(uint32_t id, off64_t &offset, off64_t &len) {
+  uint8_t chunks = addr_[6];
+  // the entry after the last one marks where the last chunk ends
+  for (int c=0; c<chunks; c++) {
+    off64_t entry = kHeaderSize + c*kChunkEntrySize;
+    if (read32(entry) != id) {
+      continue;
+    }
+    uint64_t begin, end;
+    memcpy(&begin, addr_ + entry + 4, sizeof(begin));
+    memcpy(&end, addr_ + entry + kChunkEntrySize + 4, sizeof(end));
+    begin = be64toh(begin);
+    end = be64toh(end);
+    // the midx checksum follows the last chunk
+    if (begin > end || end > (uint64_t)len_ - 20) {
+      std::cerr << file_name_ << " chunk out of bounds\n";
+      return false;
+    }
+    offset = begin;
+    len = end - begin;
+    return true;
+  }
+  return false;
+}
+
+ssize_t MultiPackIndex::populate() {
+  uint8_t chunks = addr_[6];
+  if (len_ < kHeaderSize + (chunks+1)*kChunkEntrySize + 20) {
+    std::cerr << file_name_ << " truncated\n";
+    return -1;
+  }
+  uint32_t packs = read32(8);
+
+  off64_t names, names_len, fanout_len, oids_len, offsets_len;
+  if (!chunk(kPackNames, names, names_len) ||
+      !chunk(kOidFanout, fanout_, fanout_len) ||
+      !chunk(kOidLookup, oids_, oids_len) ||
+      !chunk(kObjectOffsets, offsets_, offsets_len)) {
+    std::cerr << file_name_ << " required chunk missing\n";
+    return -1;
+  }
+  if (!chunk(kLargeOffsets, large_offsets_, large_len_)) {
+    large_len_ = 0;
+  }
+
+  // names are NUL terminated, older writers pad the chunk with NULs
+  const char *p = reinterpret_cast<const char *>(addr_ + names);
+  const char *end = p + names_len;
+  while (p < end) {
+    const char *nul = static_cast<const char *>(memchr(p, '\0', end - p));
+    if (nul == nullptr) break;
+    if (nul > p) pack_names_.push_back(std::string(p, nul - p));
+    p = nul + 1;
+  }
+  if (pack_names_.size() != packs) {
+    std::cerr << file_name_ << " has " << pack_names_.size()
+	      << " pack names for " << packs << " packs\n";
+    return -1;
+  }
+
+  if (fanout_len != 256*sizeof(uint32_t)) {
+    std::cerr << file_name_ << " bad fanout\n";
+    return -1;
+  }
+  entries_ = fanout(255);
+  if (oids_len != (off64_t)entries_*20 || offsets_len != (off64_t)entries_*8) {
+    std::cerr << file_name_ << " tables don't match the fanout\n";
+    return -1;
+  }
+  // as in the idx, find() trusts every entry
+  for (int n=1; n<256; n++) {
+    if (fanout(n) < fanout(n - 1)) {
+      std::cerr << file_name_ << " non-monotonic fanout\n";
+      return -1;
+    }
+  }
+
+  init_check_ = true;
+  return entries_;
+}
+
+uint32_t MultiPackIndex::fanout(int n) {
+  return read32(fanout_ + n*sizeof(uint32_t));
+}
+
+// same as the idx, the fanout narrows the search down to the objects
+// sharing the first byte, the rest is a binary search in place
+int64_t MultiPackIndex::find(const ObjectId &id) {
+  if (!init_check_) {
+    return -1;
+  }
+  uint32_t lo = id.bytes[0] == 0 ? 0 : fanout(id.bytes[0] - 1);
+  uint32_t hi = fanout(id.bytes[0]);
+  const uint8_t *table = addr_ + oids_;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo)/2;
+    int cmp = id.compare(table + (off64_t)mid*20);
+    if (cmp == 0) return mid;
+    if (cmp > 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return -1;
+}
+
+bool MultiPackIndex::locate(uint32_t i, uint32_t &pack, off64_t &offset) {
+  if (!init_check_ || i >= entries_) {
+    return false;
+  }
+  pack = read32(offsets_ + (off64_t)i*8);
+  uint32_t off = read32(offsets_ + (off64_t)i*8 + 4);
+  if (pack >= pack_names_.size()) {
+    return false;
+  }
+  if ((off & 0x80000000) && large_offsets_ >= 0) {
+    // the lower 31 bits index the table of 8 byte offsets.
+    // without that table the offsets are plain 32 bit ones
+    off64_t pos = (off64_t)(off & 0x7fffffff)*sizeof(uint64_t);
+    if (large_len_ < pos + (off64_t)sizeof(uint64_t)) {
+      std::cerr << "large offset out of bounds\n";
+      return false;
+    }
+    uint64_t large;
+    memcpy(&large, addr_ + large_offsets_ + pos, sizeof(large));
+    offset = be64toh(large);
+    return true;
+  }
+  offset = off;
+  return true;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "memory-mapped-file.h"
+#include "object-id.h"
+
+namespace fusism {
+
+// reads objects/pack/multi-pack-index, one sorted sha1 table across
+// many packs. like the idx, the file is mapped once and looked up in
+// place. only the chunks required to resolve objects are read
+struct MultiPackIndex {
+  MultiPackIndex(std::string file);
+
+  bool valid() { return init_check_; }
+  uint32_t count() { return entries_; }
+  // number of packs covered and their idx file names, e.g
+  // pack-4f590cabe437be9870675fff6a58c41826e4990f.idx
+  uint32_t packCount() { return pack_names_.size(); }
+  const std::string &packName(uint32_t pack) { return pack_names_[pack]; }
+
+  // index of id in the midx tables or -1
+  int64_t find(const ObjectId &id);
+  // pack (as in packName) and entry offset in that pack of the i-th
+  // object. false if the offset is out of bounds
+  bool locate(uint32_t i, uint32_t &pack, off64_t &offset);
+
+private:
+  MultiPackIndex(const MultiPackIndex&);
+  MultiPackIndex& operator=(const MultiPackIndex&);
+
+  // 12 byte header
+  //   4 byte signature MIDX
+  //   1 byte version (1)
+  //   1 byte oid version (1 is sha1)
+  //   1 byte number of chunks
+  //   1 byte number of base multi-pack-index files (0)
+  //   4 byte number of packs
+  // followed by the chunk table, (chunks+1) x 12 byte entries of
+  // 4 byte chunk id and 8 byte offset of the chunk in the file
+  enum : off64_t {
+    kHeaderSize = 12,
+    kChunkEntrySize = 12,
+  };
+
+  enum : uint32_t {
+    kPackNames = 0x504e414d,     // PNAM, NUL terminated sorted idx names
+    kOidFanout = 0x4f494446,     // OIDF, 256 x 4 byte fanout
+    kOidLookup = 0x4f49444c,     // OIDL, N x 20 byte sorted sha1s
+    kObjectOffsets = 0x4f4f4646, // OOFF, N x (4 byte pack, 4 byte offset)
+    kLargeOffsets = 0x4c4f4646,  // LOFF, 8 byte offsets, for the MSB ones
+  };
+
+  // offset and length of chunk id, false if it is missing
+  bool chunk(uint32_t id, off64_t &offset, off64_t &len);
+  uint32_t fanout(int n);
+  uint32_t read32(off64_t offset);
+  ssize_t populate();
+
+  std::string file_name_;
+  MemoryMappedFile midx_;
+  off64_t len_;
+  const uint8_t *addr_;
+  bool init_check_;
+  uint32_t entries_;
+  std::vector<std::string> pack_names_;
+  off64_t fanout_;
+  off64_t oids_;
+  off64_t offsets_;
+  off64_t large_offsets_;
+  off64_t large_len_;
+};
+
+}
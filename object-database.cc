@@ -0,0 +1,237 @@
+#include <iostream>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "object-database.h"
+#include "object-reader.h"
+#include "utils.h"
+
+namespace fusism {
+
+ObjectDatabase::ObjectDatabase(std::string git_path) : git_path_(git_path),
+							valid_(true) {
+  scanPacks();
+}
+
+// opens every .idx in objects/pack that has its .pack next to it.
+// newer packs are more likely to have what is asked for
+void ObjectDatabase::scanPacks() {
+  std::string dir = git_path_ + "/objects/pack";
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  std::vector<std::pair<int64_t, std::string> > found;
+  struct dirent *de;
+  while ((de = readdir(d)) != nullptr) {
+    std::string name = de->d_name;
+    if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".idx")) {
+      continue;
+    }
+    std::string pack = dir + "/" + name.substr(0, name.size() - 4) + ".pack";
+    struct stat sb;
+    if (stat(pack.c_str(), &sb) < 0) {
+      continue;
+    }
+    int64_t mtime = (int64_t)sb.st_mtim.tv_sec*1000000000 + sb.st_mtim.tv_nsec;
+    found.push_back(std::make_pair(mtime, dir + "/" + name));
+  }
+  closedir(d);
+
+  std::sort(found.begin(), found.end(),
+	    [](const std::pair<int64_t, std::string> &a,
+	       const std::pair<int64_t, std::string> &b) {
+	      return a.first > b.first;
+	    });
+  for (auto &f : found) {
+    std::unique_ptr<PackIdxReader> reader(new PackIdxReader(f.second, delta_cache_));
+    if (!reader->valid()) {
+      std::cerr << f.second << " cannot be opened\n";
+      valid_ = false;
+      continue;
+    }
+    packs_.push_back(std::move(reader));
+  }
+  loadMultiPackIndex();
+}
+
+// with a multi-pack-index a single lookup finds any object of the
+// packs it covers, only packs written after it still get probed
+void ObjectDatabase::loadMultiPackIndex() {
+  std::string dir = git_path_ + "/objects/pack/";
+  std::unique_ptr<MultiPackIndex> midx(new MultiPackIndex(dir + "multi-pack-index"));
+  std::vector<bool> covered(packs_.size(), false);
+  if (midx->valid()) {
+    midx_packs_.assign(midx->packCount(), nullptr);
+    for (size_t p=0; p<packs_.size(); p++) {
+      const std::string &name = packs_[p]->name();
+      if (name.compare(0, dir.size(), dir)) {
+	continue;
+      }
+      std::string base = name.substr(dir.size());
+      for (uint32_t m=0; m<midx->packCount(); m++) {
+	if (midx->packName(m) == base) {
+	  midx_packs_[m] = packs_[p].get();
+	  covered[p] = true;
+	  break;
+	}
+      }
+    }
+    midx_ = std::move(midx);
+  }
+  for (size_t p=0; p<packs_.size(); p++) {
+    if (!covered[p]) probe_.push_back(packs_[p].get());
+  }
+}
+
+std::string ObjectDatabase::loosePath(const ObjectId &id) {
+  std::string sha1 = id.hex();
+  return git_path_ + "/objects/" + sha1.substr(0,2) + "/" + sha1.substr(2);
+}
+
+ssize_t ObjectDatabase::stream(const ObjectId &id, obj_type_t &type,
+			       off64_t &size,
+			       const ZFileInflater::Sink &sink) {
+  type = OBJ_NONE;
+  if (midx_ != nullptr) {
+    int64_t pos = midx_->find(id);
+    uint32_t pack;
+    off64_t offset;
+    if (pos >= 0 && midx_->locate(pos, pack, offset) &&
+	midx_packs_[pack] != nullptr) {
+      return midx_packs_[pack]->streamAt(offset, type, size, sink);
+    }
+  }
+
+  PackIdxReader *pack = nullptr;
+  int64_t pos = -1;
+  {
+    std::lock_guard<std::mutex> guard(probe_lock_);
+    for (size_t p=0; p<probe_.size(); p++) {
+      pos = probe_[p]->find(id);
+      if (pos < 0) {
+	continue;
+      }
+      // lookups tend to cluster (a tree and its blobs, a commit and
+      // its parents), the pack that had the last one goes first next
+      if (p > 0) {
+	std::rotate(probe_.begin(), probe_.begin() + p, probe_.begin() + p + 1);
+      }
+      pack = probe_[0];
+      break;
+    }
+  }
+  if (pack != nullptr) {
+    return pack->stream(pos, type, size, sink);
+  }
+
+  std::string obj = loosePath(id);
+  if (access(obj.c_str(), F_OK|R_OK) < 0) {
+    return -1;
+  }
+  return ObjectReader(obj).stream(type, size, sink);
+}
+
+bool ObjectDatabase::contains(const ObjectId &id) {
+  if (midx_ != nullptr && midx_->find(id) >= 0) {
+    return true;
+  }
+  {
+    std::lock_guard<std::mutex> guard(probe_lock_);
+    for (auto pack : probe_) {
+      if (pack->find(id) >= 0) return true;
+    }
+  }
+  return access(loosePath(id).c_str(), F_OK) == 0;
+}
+
+void ObjectDatabase::prefetch(const ObjectId &id, Prefetcher &prefetcher) {
+  if (midx_ != nullptr) {
+    int64_t pos = midx_->find(id);
+    uint32_t pack;
+    off64_t offset;
+    if (pos >= 0 && midx_->locate(pos, pack, offset) &&
+	midx_packs_[pack] != nullptr) {
+      midx_packs_[pack]->prefetchAt(offset, prefetcher);
+      return;
+    }
+  }
+  // the lookup order is left as is, it is for the actual lookups
+  PackIdxReader *found = nullptr;
+  int64_t pos = -1;
+  {
+    std::lock_guard<std::mutex> guard(probe_lock_);
+    for (auto pack : probe_) {
+      pos = pack->find(id);
+      if (pos >= 0) {
+	found = pack;
+	break;
+      }
+    }
+  }
+  if (found != nullptr) {
+    found->prefetch(pos, prefetcher);
+  }
+}
+
+bool ObjectDatabase::read(const ObjectId &id, obj_type_t &type,
+			  std::vector<uint8_t> &out) {
+  out.clear();
+  off64_t size;
+  return stream(id, type, size, [&](const uint8_t *data, size_t len) -> bool {
+      out.insert(out.end(), data, data + len);
+      return true;
+    }) >= 0;
+}
+
+bool ObjectDatabase::cat(const ObjectId &id, OutputBuffer &out) {
+  // blobs can be larger than memory, they (and tags) are written
+  // out as they are inflated. trees and commits are collected
+  std::vector<uint8_t> data;
+  obj_type_t type;
+  off64_t size;
+  ssize_t n = stream(id, type, size, [&](const uint8_t *d, size_t len) -> bool {
+      if (type == OBJ_BLOB || type == OBJ_TAG) {
+	return out.write(d, len);
+      }
+      data.insert(data.end(), d, d + len);
+      return true;
+    });
+  if (n < 0) {
+    return false;
+  }
+  switch (type) {
+  case OBJ_BLOB:
+  case OBJ_TAG:
+    return out.write("\n");
+  case OBJ_COMMIT:
+    return catCommitTree(data.data(), data.size(), out);
+  case OBJ_TREE:
+    printTree(data.data(), data.size(), out);
+    return out.ok();
+  default:
+    std::cerr << "unknown type " << type << "\n";
+    return false;
+  }
+}
+
+// data is an inflated commit, prints the tree it points at
+bool ObjectDatabase::catCommitTree(const uint8_t *data, off64_t size,
+				   OutputBuffer &out) {
+#if DEBUG
+  std::cerr << hexdump(data, size) << "\n";
+#endif
+  ObjectId tree;
+  if (!commitTree(data, size, tree)) {
+    std::cerr << "bad tree in commit\n";
+    return false;
+  }
+
+  return cat(tree, out);
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <sys/types.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "git-object.h"
+#include "multi-pack-index.h"
+#include "object-id.h"
+#include "output-buffer.h"
+#include "pack-idx-reader.h"
+#include "z-file-inflater.h"
+
+namespace fusism {
+
+// every object of a repository: all the packs in objects/pack plus
+// the loose objects. the multi-pack-index (if any) is looked up
+// first, then the packs it doesn't cover are probed most recently
+// used first (starting out newest first, the way git does it), then
+// the loose objects. thread safe, threads share one (and with it
+// the pack readers, their fds and caches)
+// (the mappings underneath are shared)
+struct ObjectDatabase {
+  // git_path is the .git directory
+  ObjectDatabase(std::string git_path);
+
+  const std::string &path() { return git_path_; }
+  // false if a pack could not be opened. lookups would quietly
+  // miss the objects in it
+  bool valid() { return valid_; }
+
+  // hands the contents of id to sink, see PackIdxReader::stream.
+  // returns the object size or -1 if it is missing or corrupt
+  ssize_t stream(const ObjectId &id, obj_type_t &type, off64_t &size,
+		 const ZFileInflater::Sink &sink);
+  // true if id is in a pack or loose, whether it can be read or not
+  bool contains(const ObjectId &id);
+  // reads the pack entry of id ahead, see PackIdxReader::prefetch.
+  // loose objects are left alone
+  void prefetch(const ObjectId &id, Prefetcher &prefetcher);
+  // inflates the whole object into out
+  bool read(const ObjectId &id, obj_type_t &type, std::vector<uint8_t> &out);
+  // writes id to out: blobs and tags as they are, trees as a
+  // listing and commits as a listing of their tree
+  bool cat(const ObjectId &id, OutputBuffer &out);
+
+  std::vector<std::unique_ptr<PackIdxReader> > &packs() { return packs_; }
+
+private:
+  ObjectDatabase(const ObjectDatabase&);
+  ObjectDatabase& operator=(const ObjectDatabase&);
+
+  void scanPacks();
+  void loadMultiPackIndex();
+  std::string loosePath(const ObjectId &id);
+  bool catCommitTree(const uint8_t *data, off64_t size, OutputBuffer &out);
+
+  std::string git_path_;
+  bool valid_;
+  // the delta bases of every pack, bounded as a whole. before
+  // packs_, the readers use it until they are gone
+  DeltaBaseCache delta_cache_;
+  std::vector<std::unique_ptr<PackIdxReader> > packs_;
+  std::unique_ptr<MultiPackIndex> midx_;
+  // readers of the midx packs, by their midx pack id.
+  // nullptr for the ones that are gone since the midx was written
+  std::vector<PackIdxReader *> midx_packs_;
+  // packs not covered by the midx, in lookup order
+  std::vector<PackIdxReader *> probe_;
+  // protects the order of probe_
+  std::mutex probe_lock_;
+};
+
+}
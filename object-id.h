@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include <type_traits>
+
+namespace fusism {
+
+// binary sha1 of a git object. 20 bytes inline, no allocation,
+// trivially copyable so tables of them can be memcpy'd around
+struct ObjectId {
+  enum : uint32_t {
+    kRawSize = 20,
+    kHexSize = 40,
+  };
+
+  uint8_t bytes[kRawSize];
+
+  static ObjectId fromRaw(const uint8_t *raw) {
+    ObjectId id;
+    memcpy(id.bytes, raw, kRawSize);
+    return id;
+  }
+
+  // parses exactly 40 hex digits (NUL terminated if terminated is set).
+  // returns false if hex is not a sha1
+  static bool fromHex(const char *hex, ObjectId &id, bool terminated=true) {
+    for (uint32_t i=0; i<kRawSize; i++) {
+      int hi = hexval(hex[2*i]);
+      if (hi < 0) return false;
+      int lo = hexval(hex[2*i+1]);
+      if (lo < 0) return false;
+      id.bytes[i] = (hi << 4) | lo;
+    }
+    return !terminated || hex[kHexSize] == '\0';
+  }
+
+  // writes the 40 hex digits to out, no NUL is appended
+  void hex(char *out) const {
+    static const char digits[] = "0123456789abcdef";
+    for (uint32_t i=0; i<kRawSize; i++) {
+      out[2*i] = digits[bytes[i] >> 4];
+      out[2*i+1] = digits[bytes[i] & 0xf];
+    }
+  }
+
+  std::string hex() const {
+    char buf[kHexSize];
+    hex(buf);
+    return std::string(buf, kHexSize);
+  }
+
+  int compare(const uint8_t *raw) const {
+    return memcmp(bytes, raw, kRawSize);
+  }
+  bool operator==(const ObjectId &o) const { return compare(o.bytes) == 0; }
+  bool operator!=(const ObjectId &o) const { return compare(o.bytes) != 0; }
+  bool operator<(const ObjectId &o) const { return compare(o.bytes) < 0; }
+
+private:
+  static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+};
+
+static_assert(sizeof(ObjectId) == ObjectId::kRawSize,
+	      "ObjectId must be exactly a raw sha1");
+static_assert(std::is_trivially_copyable<ObjectId>::value,
+	      "ObjectId must be trivially copyable");
+
+}
+
+namespace std {
+  // sha1s are already uniformly distributed, the first bytes will do
+  template<> struct hash<fusism::ObjectId> {
+    size_t operator()(const fusism::ObjectId &id) const {
+      size_t h;
+      memcpy(&h, id.bytes, sizeof(h));
+      return h;
+    }
+  };
+}
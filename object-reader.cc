@@ -0,0 +1,69 @@
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "object-reader.h"
+
+namespace fusism {
+
+ObjectReader::ObjectReader(std::string obj_path) : path_(obj_path) {
+  fd_ = open(obj_path.c_str(), O_RDONLY);
+}
+
+ObjectReader::~ObjectReader() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+ssize_t ObjectReader::stream(obj_type_t &type, off64_t &size,
+			     const ZFileInflater::Sink &sink) {
+  if (fd_ < 0) {
+    return -1;
+  }
+  // header is "<type> <decimal size>\0" followed by the contents.
+  // the header is collected until its NUL, everything after
+  // goes straight to sink
+  std::string header;
+  bool in_header = true;
+  size = -1;
+  ssize_t inflated = ZFileInflater(fd_).inflate(
+    [&](const uint8_t *data, size_t len) -> bool {
+      if (in_header) {
+	const void *nul = memchr(data, '\0', len);
+	size_t h = (nul == nullptr) ? len :
+	  static_cast<const uint8_t *>(nul) - data;
+	header.append(reinterpret_cast<const char *>(data), h);
+	if (nul == nullptr) {
+	  return header.size() < 32;
+	}
+	size_t sp = header.find(' ');
+	if (sp == std::string::npos ||
+	    (type = strToType(header.data(), sp)) == OBJ_NONE) {
+	  return false;
+	}
+	size = atoll(header.c_str() + sp + 1);
+	if (size < 0) {
+	  return false;
+	}
+	in_header = false;
+	data += h + 1;
+	len -= h + 1;
+      }
+      return len == 0 || sink(data, len);
+    });
+
+  if (in_header) {
+    std::cerr << path_ << " bad object header\n";
+    return -1;
+  }
+  if (inflated < 0 || inflated != (ssize_t)(header.size() + 1) + size) {
+    return -1;
+  }
+  return size;
+}
+
+}
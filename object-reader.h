@@ -0,0 +1,30 @@
+#pragma once
+#include <sys/types.h>
+#include <string>
+
+#include "git-object.h"
+#include "z-file-inflater.h"
+
+namespace fusism {
+
+// reads a loose object, objects/xx/yyyy...
+struct ObjectReader {
+  ObjectReader(std::string obj_path);
+  ~ObjectReader();
+
+  bool valid() { return fd_ >= 0; }
+  // hands the contents of the object (its "<type> <size>\0" header
+  // stripped) to sink as they are inflated. type and size are set
+  // before sink is first called. returns the object size or -1
+  ssize_t stream(obj_type_t &type, off64_t &size,
+		 const ZFileInflater::Sink &sink);
+
+private:
+  ObjectReader(const ObjectReader&);
+  ObjectReader& operator=(const ObjectReader&);
+
+  std::string path_;
+  int fd_;
+};
+
+}
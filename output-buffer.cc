@@ -0,0 +1,80 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output-buffer.h"
+
+namespace fusism {
+
+  OutputBuffer::OutputBuffer(int fd, size_t capacity) : fd_(fd),
+							buf_(capacity),
+							len_(0),
+							ok_(true) { }
+
+  OutputBuffer::~OutputBuffer() {
+    flush();
+  }
+
+  bool OutputBuffer::write(const void *data, size_t len) {
+    if (!ok_) {
+      return false;
+    }
+    if (len >= buf_.size()) {
+      return writeAll(static_cast<const uint8_t *>(data), len);
+    }
+    if (buf_.size() - len_ < len && !flush()) {
+      return false;
+    }
+    memcpy(buf_.data() + len_, data, len);
+    len_ += len;
+    return true;
+  }
+
+  bool OutputBuffer::write(const char *s) {
+    return write(s, strlen(s));
+  }
+
+  bool OutputBuffer::flush() {
+    if (len_ == 0 || !ok_) {
+      return ok_;
+    }
+    return writeAll(nullptr, 0);
+  }
+
+  bool OutputBuffer::writeAll(const uint8_t *data, size_t len) {
+    struct iovec iov[2];
+    int count = 0;
+    if (len_ > 0) {
+      iov[count].iov_base = buf_.data();
+      iov[count++].iov_len = len_;
+    }
+    if (len > 0) {
+      iov[count].iov_base = const_cast<uint8_t *>(data);
+      iov[count++].iov_len = len;
+    }
+    len_ = 0;
+    struct iovec *v = iov;
+    while (count > 0) {
+      ssize_t n = ::writev(fd_, v, count);
+      if (n < 0) {
+	if (errno == EINTR) continue;
+	perror("write");
+	ok_ = false;
+	return false;
+      }
+      // skip what went out, possibly in the middle of an iovec
+      while (count > 0 && (size_t)n >= v->iov_len) {
+	n -= v->iov_len;
+	v++;
+	count--;
+      }
+      if (count > 0) {
+	v->iov_base = static_cast<uint8_t *>(v->iov_base) + n;
+	v->iov_len -= n;
+      }
+    }
+    return true;
+  }
+}
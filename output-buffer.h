@@ -0,0 +1,38 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <vector>
+
+namespace fusism {
+  // buffered writer on top of a file descriptor. small writes are
+  // gathered into one large write(2), writes larger than the buffer
+  // go straight through, together with what is pending in a single
+  // writev(2), without being copied. the fd is not owned
+  struct OutputBuffer {
+    enum : size_t {
+      // about what a pipe takes in before the reader catches up
+      kDefaultCapacity = 1 << 20,
+    };
+
+    OutputBuffer(int fd, size_t capacity=kDefaultCapacity);
+    // flushes what is left
+    ~OutputBuffer();
+    bool write(const void *data, size_t len);
+    bool write(const char *s);
+    bool flush();
+    // false once a write failed (e.g the reader went away)
+    bool ok() { return ok_; }
+    size_t pending() { return len_; }
+  private:
+    OutputBuffer(const OutputBuffer&);
+    OutputBuffer& operator=(const OutputBuffer&);
+
+    // writes the pending bytes then data, false on error
+    bool writeAll(const uint8_t *data, size_t len);
+
+    int fd_;
+    std::vector<uint8_t> buf_;
+    size_t len_;
+    bool ok_;
+  };
+}
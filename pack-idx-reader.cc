@@ -0,0 +1,736 @@
+// on https://github.com/git/git/blob/master/Documentation/technical/pack-format.txt
+// opens the idx file first and searches for the corresponding pack file
+
+// shoutout to Ben Hoyt's explanation of the pack encoding scheme
+// at https://github.com/benhoyt/pygit/blob/master/pygit.py#L441
+
+#include <cassert>
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include <endian.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <memory>
+
+#include "crc32.h"
+#include "delta-patcher.h"
+#include "pack-idx-reader.h"
+#include "sha1.h"
+#include "thread-pool.h"
+
+namespace fusism {
+
+PackIdxReader::PackIdxReader(std::string file,
+			     DeltaBaseCache &delta_cache) : file_name_(file),
+							    cursor_(0),
+							    idx_(-1),
+							    len_(0),
+							    addr_ (nullptr),
+							    init_check_(false),
+							    packed_fd_(-1),
+							    pack_size_(-1),
+							    entries_(0),
+							    has_rev_file_(false),
+							    delta_cache_(delta_cache) {
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    perror("open");
+    return;
+  }
+  // the idx is small compared to the pack, map it in one go.
+  // the mapping is shared with any other reader of the same idx
+  idx_ = MemoryMappedFile(fd, MemoryMappedFile::kWholeFile);
+  len_ = idx_.size();
+  addr_ = idx_.span(0, len_);
+  if (addr_ == nullptr || len_ < kSha1Offset) {
+    std::cerr << "mmap failed\n";
+    return;
+  }
+
+  char magic[5] = {0};
+  readBytes(&magic, 4);
+  if (strcmp(magic, "\377tOc")) {
+    std::cerr << "not an idx file\n";
+    return;
+  }
+
+  uint32_t version;
+  readBytes(&version, sizeof(version));
+  version = ntohl(version);
+  if (version != 2) {
+    std::cerr << "version > 2 unsupported" << "\n";
+    return;
+  }
+
+  if (setupPackedFd() < 0) {
+    std::cerr << "no companion pack file found\n";
+    return;
+  }
+  struct stat sb;
+  if (fstat(packed_fd_, &sb) < 0) {
+    perror("fstat");
+    return;
+  }
+  pack_size_ = sb.st_size;
+
+  populate();
+}
+
+PackIdxReader::~PackIdxReader() {
+  if (packed_fd_ != -1) {
+    close(packed_fd_);
+  }
+}
+
+PackIdxReader::Lease::Lease(PackIdxReader &r) : reader(r), cursor(nullptr) {
+  std::lock_guard<std::mutex> guard(reader.cursors_lock_);
+  if (reader.cursors_.empty()) {
+    cursor = new Cursor(reader.packed_fd_);
+  } else {
+    cursor = reader.cursors_.back().release();
+    reader.cursors_.pop_back();
+  }
+}
+
+PackIdxReader::Lease::~Lease() {
+  // an idle cursor must not pin its window, only reads in flight
+  // may take the cache over its limit
+  cursor->pack.release();
+  std::lock_guard<std::mutex> guard(reader.cursors_lock_);
+  reader.cursors_.emplace_back(cursor);
+}
+
+ObjectId PackIdxReader::id(uint32_t i) {
+  return ObjectId::fromRaw(addr_ + kSha1Offset + (off64_t)i*20);
+}
+
+ssize_t PackIdxReader::stream(uint32_t i, obj_type_t &type, off64_t &size,
+			      const ZFileInflater::Sink &sink) {
+  if (!init_check_ || i >= entries_) {
+    return -1;
+  }
+  return streamAt(packOffset(i), type, size, sink);
+}
+
+ssize_t PackIdxReader::streamAt(off64_t offset, obj_type_t &type,
+				off64_t &size,
+				const ZFileInflater::Sink &sink) {
+  if (!init_check_) {
+    return -1;
+  }
+  Lease c(*this);
+  PackObject po = objectAt(c->pack, offset);
+  switch (po.type()) {
+  case OBJ_COMMIT:
+  case OBJ_TREE:
+  case OBJ_BLOB:
+  case OBJ_TAG:
+    // objects can be larger than memory, stream them out
+    // as they are inflated
+    type = po.type();
+    size = po.size();
+    return ZFileInflater(c->pack, po.offset(), po.size(),
+			 streamLength(po.entry(), po.offset())).inflate(sink);
+  default: {
+    std::vector<uint8_t> &out = c->scratch;
+    if (!unpack(*c.cursor, po.entry(), type, out)) {
+      return -1;
+    }
+    size = out.size();
+    if (!out.empty() && !sink(out.data(), out.size())) {
+      return -1;
+    }
+    return out.size();
+  }
+  }
+}
+
+void PackIdxReader::prefetch(uint32_t i, Prefetcher &prefetcher) {
+  if (!init_check_ || i >= entries_) {
+    return;
+  }
+  prefetchAt(packOffset(i), prefetcher);
+}
+
+void PackIdxReader::prefetchAt(off64_t offset, Prefetcher &prefetcher) {
+  if (!init_check_) {
+    return;
+  }
+  off64_t end = entryEnd(offset);
+  prefetcher.prefetch(packed_fd_, offset,
+		      end > offset ? end - offset : (off64_t)kPrefetchGuess);
+}
+
+// the pack is scanned once to build the forest of delta bases and
+// their deltas, then each tree of the forest is resolved on a work
+// stealing pool: a base is inflated once and all its child deltas
+// are applied to it, grandchildren become new tasks.
+uint32_t PackIdxReader::decodeAll(unsigned threads, const ObjectSink &sink) {
+  if (!init_check_) {
+    std::cerr << "init_check failed" << "\n";
+    return entries_;
+  }
+
+  struct Node {
+    obj_type_t type;
+    off64_t data;
+    off64_t size;
+    // where the entry ends, i.e the next one starts
+    off64_t end;
+    std::vector<uint32_t> children;
+  };
+  std::vector<Node> nodes(entries_);
+  // maps delta base offsets back to idx positions, and gives
+  // the exact compressed length of every object
+  PackReverseIndex *rev = reverseIndex(true);
+  for (uint32_t k=0; k<entries_; ++k) {
+    uint32_t i = rev->at(k);
+    if (i >= entries_) {
+      std::cerr << "bad reverse index\n";
+      return entries_;
+    }
+    nodes[i].end = k+1 < entries_ ? packOffset(rev->at(k+1)) : pack_size_ - 20;
+  }
+
+  std::vector<uint32_t> roots;
+  std::vector<uint32_t> orphans;
+  Lease c(*this);
+  for (uint32_t i=0; i<entries_; ++i) {
+    PackObject po = object(c->pack, i);
+    Node &node = nodes[i];
+    node.type = po.type();
+    node.data = po.offset();
+    node.size = po.size();
+    switch (po.type()) {
+    case OBJ_COMMIT:
+    case OBJ_TREE:
+    case OBJ_BLOB:
+    case OBJ_TAG:
+      roots.push_back(i);
+      break;
+    case OBJ_OFS_DELTA:
+    case OBJ_REF_DELTA: {
+      off64_t base = deltaBase(c->pack, po, node.data);
+      int64_t pos = base < 0 ? -1 : rev->find(base);
+      if (pos < 0) {
+	orphans.push_back(i);
+      } else {
+	nodes[rev->at(pos)].children.push_back(i);
+      }
+      break;
+    }
+    default:
+      orphans.push_back(i);
+      break;
+    }
+  }
+
+  // set once an object was handed to the sink or counted as failed.
+  // every worker writes its own elements only
+  std::vector<uint8_t> accounted(entries_, 0);
+  // an object that can't be decoded takes its whole subtree with it
+  std::function<uint32_t(uint32_t)> subtree = [&](uint32_t i) -> uint32_t {
+    accounted[i] = 1;
+    uint32_t n = 1;
+    for (uint32_t c : nodes[i].children) n += subtree(c);
+    return n;
+  };
+  std::atomic<uint32_t> failed(0);
+  for (uint32_t i : orphans) {
+    failed += subtree(i);
+  }
+
+  ThreadPool pool(threads);
+  // a MemoryMappedFile is not thread safe, one per worker.
+  // the windows underneath are shared anyway
+  std::vector<MemoryMappedFile> maps;
+  for (unsigned w=0; w<pool.size(); w++) {
+    maps.emplace_back(packed_fd_, MemoryMappedFile::kPackWindow, false);
+  }
+
+  typedef std::shared_ptr<const std::vector<uint8_t> > Object;
+  std::function<void(uint32_t, obj_type_t, Object)> resolve;
+  resolve = [&](uint32_t i, obj_type_t type, Object data) {
+    accounted[i] = 1;
+    sink(i, type, *data);
+    MemoryMappedFile &pack = maps[pool.currentWorker()];
+    std::vector<uint8_t> delta;
+    for (uint32_t c : nodes[i].children) {
+      std::shared_ptr<std::vector<uint8_t> > out(new std::vector<uint8_t>());
+      if (ZFileInflater(pack, nodes[c].data, nodes[c].size,
+			nodes[c].end - nodes[c].data).inflate(delta) < 0 ||
+	  DeltaPatcher(delta.data(), delta.size()).apply(data->data(),
+							 data->size(),
+							 *out) < 0) {
+	failed += subtree(c);
+	continue;
+      }
+      if (nodes[c].children.empty()) {
+	accounted[c] = 1;
+	sink(c, type, *out);
+      } else {
+	pool.submit([&resolve, c, type, out]() { resolve(c, type, out); });
+      }
+    }
+  };
+
+  for (uint32_t r : roots) {
+    pool.submit([&, r]() {
+	MemoryMappedFile &pack = maps[pool.currentWorker()];
+	std::shared_ptr<std::vector<uint8_t> > data(new std::vector<uint8_t>());
+	if (ZFileInflater(pack, nodes[r].data, nodes[r].size,
+			  nodes[r].end - nodes[r].data).inflate(*data) < 0) {
+	  failed += subtree(r);
+	  return;
+	}
+	resolve(r, nodes[r].type, data);
+      });
+  }
+  pool.wait();
+
+  // deltas whose chain never reaches a base, e.g REF_DELTAs that are
+  // each other's base, are in no tree walked above
+  uint32_t unreachable = 0;
+  for (uint32_t i=0; i<entries_; ++i) {
+    if (!accounted[i]) unreachable++;
+  }
+  if (unreachable > 0) {
+    std::cerr << name() << ": " << unreachable
+	      << " deltas with no base at the end of their chain\n";
+    failed += unreachable;
+  }
+  return failed;
+}
+
+int PackIdxReader::list() {
+  if (!init_check_) {
+    std::cerr << "init_check failed" << "\n";
+    return -1;
+  }
+
+  // the packed sizes come for free once the reverse index is there
+  reverseIndex(true);
+  Lease c(*this);
+  for (uint32_t i=0; i<entries_; ++i) {
+    PackObject po = object(c->pack, i);
+    std::cerr << po.id().hex()
+	      << " "
+	      << std::setw(8) << po.size()
+	      << " "
+	      << std::setw(8) << packedSize(i)
+	      << " "
+	      << typeToStr(po.type())
+	      << "\n";
+  }
+  return 0;
+}
+
+uint32_t PackIdxReader::verify(unsigned threads) {
+  if (!init_check_) {
+    std::cerr << "init_check failed" << "\n";
+    return 1;
+  }
+  std::atomic<uint32_t> problems(0);
+
+  // the idx covers itself, and has a copy of the pack checksum
+  Sha1 idx_sha1;
+  idx_sha1.update(addr_, len_ - 20);
+  if (idx_sha1.final().compare(addr_ + len_ - 20) != 0) {
+    std::cerr << file_name_ << " idx checksum mismatch\n";
+    problems++;
+  }
+  Lease c(*this);
+  const uint8_t *header = c->pack.span(0, 12);
+  uint32_t version, count;
+  if (header == nullptr || memcmp(header, "PACK", 4)) {
+    std::cerr << file_name_ << " not a pack\n";
+    return problems + 1;
+  }
+  memcpy(&version, header + 4, sizeof(version));
+  memcpy(&count, header + 8, sizeof(count));
+  if ((ntohl(version) != 2 && ntohl(version) != 3) || ntohl(count) != entries_) {
+    std::cerr << file_name_ << " pack header doesn't match the idx\n";
+    problems++;
+  }
+
+  PackReverseIndex *rev = reverseIndex(true);
+  ThreadPool pool(threads);
+  std::vector<MemoryMappedFile> maps;
+  for (unsigned w=0; w<pool.size(); w++) {
+    maps.emplace_back(packed_fd_, MemoryMappedFile::kPackWindow, false);
+  }
+
+  // the pack checksum is one long sequential hash, it runs on a
+  // worker of its own while the others check the crc32s
+  const off64_t data_len = pack_size_ - 20;
+  ObjectId pack_checksum = ObjectId::fromRaw(addr_ + len_ - 2*20);
+  pool.submit([&]() {
+      MemoryMappedFile &pack = maps[pool.currentWorker()];
+      Sha1 sha1;
+      for (off64_t pos=0; pos<data_len; ) {
+	off64_t n = std::min<off64_t>(data_len - pos, MemoryMappedFile::kPackWindow/2);
+	const uint8_t *data = pack.span(pos, n);
+	if (data == nullptr) {
+	  std::cerr << file_name_ << " pack unreadable at " << pos << "\n";
+	  problems++;
+	  return;
+	}
+	sha1.update(data, n);
+	pos += n;
+      }
+      const uint8_t *trailer = pack.span(data_len, 20);
+      if (trailer == nullptr || sha1.final().compare(trailer) != 0) {
+	std::cerr << file_name_ << " pack checksum mismatch\n";
+	problems++;
+      } else if (pack_checksum.compare(trailer) != 0) {
+	std::cerr << file_name_ << " pack checksum doesn't match the idx\n";
+	problems++;
+      }
+    });
+
+  // the crc32s of the raw entries (header included), in pack order
+  // and in batches so that neighbouring entries share windows
+  const uint32_t batch = 1024;
+  for (uint32_t first=0; first<entries_; first+=batch) {
+    pool.submit([&, first]() {
+	MemoryMappedFile &pack = maps[pool.currentWorker()];
+	uint32_t last = std::min(first + batch, entries_);
+	for (uint32_t k=first; k<last; ++k) {
+	  uint32_t i = rev->at(k);
+	  if (i >= entries_) {
+	    problems++;
+	    continue;
+	  }
+	  off64_t entry = packOffset(i);
+	  off64_t end = k+1 < entries_ ? packOffset(rev->at(k+1)) : data_len;
+	  uint32_t crc = 0;
+	  for (off64_t pos=entry; pos<end; ) {
+	    off64_t n = std::min<off64_t>(end - pos, MemoryMappedFile::kPackWindow/2);
+	    const uint8_t *data = pack.span(pos, n);
+	    if (data == nullptr) {
+	      break;
+	    }
+	    crc = Crc32::update(crc, data, n);
+	    pos += n;
+	  }
+	  if (crc != crc32(i)) {
+	    std::cerr << id(i).hex() << " crc32 mismatch\n";
+	    problems++;
+	  }
+	}
+      });
+  }
+  pool.wait();
+
+  // and every object hashes back to its id
+  uint32_t failed = decodeAll(threads, [&](uint32_t i, obj_type_t type,
+					   const std::vector<uint8_t> &data) {
+      ObjectId expected = id(i);
+      if (Sha1::object(typeToStr(type).c_str(), data.data(), data.size()) != expected) {
+	std::cerr << expected.hex() << " sha1 mismatch\n";
+	problems++;
+      }
+    });
+  if (failed > 0) {
+    std::cerr << file_name_ << " " << failed << " objects could not be decoded\n";
+  }
+  return problems + failed;
+}
+
+off64_t PackIdxReader::packedSize(uint32_t i) {
+  if (!init_check_ || i >= entries_) {
+    return -1;
+  }
+  off64_t entry = packOffset(i);
+  off64_t end = entryEnd(entry);
+  return end < 0 ? -1 : end - entry;
+}
+
+PackReverseIndex *PackIdxReader::reverseIndex(bool build) {
+  std::lock_guard<std::mutex> guard(rev_lock_);
+  if (rev_ == nullptr && (build || has_rev_file_)) {
+    rev_.reset(new PackReverseIndex(rev_name_, entries_, addr_ + len_ - 2*20,
+				    [this](uint32_t i) -> off64_t {
+					return i < entries_ ? packOffset(i) : -1;
+				      }));
+  }
+  return rev_.get();
+}
+
+off64_t PackIdxReader::entryEnd(off64_t entry) {
+  PackReverseIndex *rev = reverseIndex(false);
+  if (rev == nullptr) {
+    return -1;
+  }
+  int64_t pos = rev->find(entry);
+  if (pos < 0) {
+    return -1;
+  }
+  if (pos + 1 == entries_) {
+    // the last entry runs up to the pack checksum
+    return pack_size_ - 20;
+  }
+  return packOffset(rev->at(pos + 1));
+}
+
+off64_t PackIdxReader::streamLength(off64_t entry, off64_t data) {
+  off64_t end = entryEnd(entry);
+  return end < data ? -1 : end - data;
+}
+
+uint32_t PackIdxReader::fanout(int n) {
+  uint32_t v;
+  memcpy(&v, addr_ + kFanoutOffset + n*sizeof(uint32_t), sizeof(v));
+  return ntohl(v);
+}
+
+uint32_t PackIdxReader::crc32(uint32_t i) {
+  uint32_t v;
+  memcpy(&v, addr_ + tableOffset(kCrc32Table) + (off64_t)i*sizeof(uint32_t),
+	 sizeof(v));
+  return ntohl(v);
+}
+
+// the fanout narrows the search down to the objects sharing the first
+// byte, the rest is a binary search straight over the mapped sha1 table
+int64_t PackIdxReader::find(const ObjectId &id) {
+  if (!init_check_) {
+    return -1;
+  }
+  uint32_t lo = id.bytes[0] == 0 ? 0 : fanout(id.bytes[0] - 1);
+  uint32_t hi = fanout(id.bytes[0]);
+  const uint8_t *table = addr_ + kSha1Offset;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo)/2;
+    int cmp = id.compare(table + (off64_t)mid*20);
+    if (cmp == 0) return mid;
+    if (cmp > 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return -1;
+}
+
+// where each of the per object tables starts in the idx
+off64_t PackIdxReader::tableOffset(int table) {
+  if (table == kSha1Table) return kSha1Offset;
+  return kSha1Offset + (off64_t)entries_*(20 + (table-1)*sizeof(uint32_t));
+}
+
+// offset of the i-th object's entry in the pack, -1 if unsupported
+off64_t PackIdxReader::packOffset(uint32_t i) {
+  uint32_t offset;
+  memcpy(&offset, addr_ + tableOffset(kOffsetTable) + (off64_t)i*sizeof(uint32_t),
+	 sizeof(offset));
+  offset = ntohl(offset);
+  if (offset & 0x80000000) {
+    // packs beyond 2GiB. the lower 31 bits index the table
+    // of 8 byte offsets that follows the 4 byte ones
+    off64_t pos = tableOffset(kLargeOffsetTable) +
+      (off64_t)(offset & 0x7fffffff)*sizeof(uint64_t);
+    // the pack and idx checksums are still to follow
+    if (len_ - 2*20 < pos + (off64_t)sizeof(uint64_t)) {
+      std::cerr << "large offset out of bounds\n";
+      return -1;
+    }
+    uint64_t large;
+    memcpy(&large, addr_ + pos, sizeof(large));
+    return be64toh(large);
+  }
+  return offset;
+}
+
+// the i-th object of the idx. its type and size live in the
+// entry header in the pack and are only decoded here, when the
+// object is actually asked for
+PackIdxReader::PackObject PackIdxReader::object(MemoryMappedFile &pack,
+						 uint32_t i) {
+  PackObject po = objectAt(pack, packOffset(i));
+  po.setId(id(i));
+  return po;
+}
+
+// the object whose entry starts at offset in the pack.
+// its id is not known (it would take a reverse lookup)
+PackIdxReader::PackObject PackIdxReader::objectAt(MemoryMappedFile &pack,
+						   off64_t offset) {
+  PackObject po(ObjectId(), OBJ_NONE, offset, -1);
+  if (offset < 0 || offset >= pack_size_) {
+    return po;
+  }
+  off64_t cursor = offset;
+  po.update([&](void) -> uint8_t {
+      return pack[cursor++];
+    });
+  po.setOffset(cursor);
+  return po;
+}
+
+// entry offset of the base of a delta, -1 if it can't be found.
+// sets data to where the delta's own zlib stream starts
+off64_t PackIdxReader::deltaBase(MemoryMappedFile &pack, PackObject &po,
+				 off64_t &data) {
+  off64_t cursor = po.offset();
+  if (po.type() == OBJ_OFS_DELTA) {
+    // offset back from the delta's entry, big endian base 128
+    // with an implicit +1 on every continuation byte
+    uint8_t byte = pack[cursor++];
+    off64_t back = byte & 0x7f;
+    while (byte & 0x80) {
+      if (back > (INT64_MAX >> 7)) return -1;
+      byte = pack[cursor++];
+      back = ((back + 1) << 7) | (byte & 0x7f);
+    }
+    data = cursor;
+    if (back <= 0 || back > po.entry()) return -1;
+    return po.entry() - back;
+  }
+  if (po.type() == OBJ_REF_DELTA) {
+    const uint8_t *raw = pack.span(cursor, ObjectId::kRawSize);
+    if (raw == nullptr) return -1;
+    ObjectId base = ObjectId::fromRaw(raw);
+    data = cursor + ObjectId::kRawSize;
+    int64_t pos = find(base);
+    if (pos < 0) {
+      // thin packs can refer to objects outside the pack
+      std::cerr << base.hex() << " delta base not in pack\n";
+      return -1;
+    }
+    return packOffset(pos);
+  }
+  return -1;
+}
+
+// inflates the object whose entry starts at offset into out,
+// resolving delta chains down to their base. type is set to the
+// type of the final object. every base a delta is applied to ends
+// up in the delta base cache, so walking a chain again (or another
+// chain sharing a base) only inflates the deltas
+bool PackIdxReader::unpack(Cursor &c, off64_t offset, obj_type_t &type,
+			   std::vector<uint8_t> &out) {
+  // deltas between offset and the base, outermost first
+  std::vector<PackObject> chain;
+  std::vector<off64_t> chain_data;
+  DeltaBaseCache::Object base;
+  off64_t cursor = offset;
+  while (base == nullptr) {
+    int cached_type;
+    if ((base = delta_cache_.get(this, cursor, cached_type)) != nullptr) {
+      type = (obj_type_t)cached_type;
+      break;
+    }
+    PackObject po = objectAt(c.pack, cursor);
+    switch (po.type()) {
+    case OBJ_COMMIT:
+    case OBJ_TREE:
+    case OBJ_BLOB:
+    case OBJ_TAG: {
+      type = po.type();
+      off64_t in_len = streamLength(cursor, po.offset());
+      if (chain.empty()) {
+	return ZFileInflater(c.pack, po.offset(), po.size(), in_len).inflate(out) >= 0;
+      }
+      std::shared_ptr<std::vector<uint8_t> > inflated(new std::vector<uint8_t>());
+      if (ZFileInflater(c.pack, po.offset(), po.size(), in_len).inflate(*inflated) < 0) {
+	return false;
+      }
+      delta_cache_.put(this, cursor, type, inflated);
+      base = inflated;
+      break;
+    }
+    case OBJ_OFS_DELTA:
+    case OBJ_REF_DELTA: {
+      off64_t data;
+      off64_t next = deltaBase(c.pack, po, data);
+      if (next < 0 || chain.size() >= kMaxDeltaChain) {
+	std::cerr << "bad delta chain at " << po.entry() << "\n";
+	return false;
+      }
+      chain.push_back(po);
+      chain_data.push_back(data);
+      cursor = next;
+      break;
+    }
+    default:
+      std::cerr << "unknown type " << po.type() << " at " << cursor << "\n";
+      return false;
+    }
+  }
+
+  // apply the deltas, innermost first. intermediate results are
+  // bases of the next link and get cached, the last one goes to out
+  for (size_t i=chain.size(); i-- > 0; ) {
+    if (ZFileInflater(c.pack, chain_data[i], chain[i].size(),
+		      streamLength(chain[i].entry(), chain_data[i])).inflate(c.delta) < 0) {
+      return false;
+    }
+    DeltaPatcher patcher(c.delta.data(), c.delta.size());
+    if (i == 0) {
+      return patcher.apply(base->data(), base->size(), out) >= 0;
+    }
+    std::shared_ptr<std::vector<uint8_t> > result(new std::vector<uint8_t>());
+    if (patcher.apply(base->data(), base->size(), *result) < 0) {
+      return false;
+    }
+    delta_cache_.put(this, chain[i].entry(), type, result);
+    base = result;
+  }
+  // offset itself was a cached base
+  out.assign(base->begin(), base->end());
+  return true;
+}
+
+ssize_t PackIdxReader::populate() {
+  // last element of the fan out table has total num of objects.
+  // nothing else is read upfront, just check that the tables
+  // (and the trailing pack and idx checksums) are all there
+  entries_ = fanout(255);
+  if (len_ < tableOffset(kLargeOffsetTable) + 2*20) {
+    std::cerr << "idx file truncated\n";
+    return -1;
+  }
+  // every entry bounds a search in find(), fanout(255) being in
+  // range is not enough
+  for (int n=1; n<256; n++) {
+    if (fanout(n) < fanout(n - 1)) {
+      std::cerr << "non-monotonic fanout in idx\n";
+      return -1;
+    }
+  }
+
+  init_check_ = true;
+  return entries_;
+}
+
+int PackIdxReader::setupPackedFd() {
+  int pos = file_name_.rfind(".idx");
+  if (pos == -1) {
+    std::cerr << "no idx file suffix found\n";
+    return -1;
+  }
+
+  std::string pack_str = file_name_.substr(0, pos) + ".pack";
+  rev_name_ = file_name_.substr(0, pos) + ".rev";
+  has_rev_file_ = access(rev_name_.c_str(), R_OK) == 0;
+  packed_fd_ = open(pack_str.c_str(), O_RDONLY);
+  if (packed_fd_ < 0) {
+    std::cerr << "couldn't find pack string\n";
+    return -1;
+  }
+  return 0;
+}
+
+ssize_t PackIdxReader::readBytes(void *bytes, off64_t num) {
+  assert(len_ - cursor_ > num);
+  memcpy(bytes, addr_ + cursor_, num);
+  cursor_ += num;
+  return num;
+}
+
+} //namespace fusism
@@ -0,0 +1,217 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "delta-base-cache.h"
+#include "git-object.h"
+#include "memory-mapped-file.h"
+#include "object-id.h"
+#include "pack-reverse-index.h"
+#include "prefetcher.h"
+#include "z-file-inflater.h"
+
+namespace fusism {
+
+// reads a v2 .idx and its companion .pack. lookups go straight to the
+// mapped idx, entry headers in the pack are only decoded when an
+// object is asked for. thread safe: the idx mapping, the pack fd and
+// the delta base cache (shared with the other packs of the repository
+// too) are shared, what a lookup changes (a view of
+// the pack and its buffers) is leased from a pool for the duration
+// of the lookup, so there are as many as there are concurrent lookups
+struct PackIdxReader {
+  // receives every decoded object of the pack (with its index in the
+  // idx). called concurrently from the decoding threads
+  typedef std::function<void(uint32_t i, obj_type_t type,
+			     const std::vector<uint8_t> &data)> ObjectSink;
+
+  // delta_cache is where the bases of delta chains are kept, it
+  // must outlive the reader
+  PackIdxReader(std::string file, DeltaBaseCache &delta_cache);
+  ~PackIdxReader();
+
+  bool valid() { return init_check_; }
+  const std::string &name() { return file_name_; }
+  uint32_t count() { return entries_; }
+
+  // index of id in the idx tables or -1
+  int64_t find(const ObjectId &id);
+  ObjectId id(uint32_t i);
+  // hands the contents of the i-th object to sink. type and size
+  // are set before sink is first called. undeltified objects are
+  // streamed straight out of the pack as they inflate, deltas are
+  // resolved in memory first. returns the object size or -1
+  ssize_t stream(uint32_t i, obj_type_t &type, off64_t &size,
+		 const ZFileInflater::Sink &sink);
+  // same for the object whose entry starts at offset in the pack
+  // (e.g as found through a multi-pack-index)
+  ssize_t streamAt(off64_t offset, obj_type_t &type, off64_t &size,
+		   const ZFileInflater::Sink &sink);
+  // has the entry of the i-th object (or the one starting at offset)
+  // read ahead. the exact extent is known with a .rev, otherwise a
+  // guess is read and the kernel's readahead goes on from there
+  void prefetch(uint32_t i, Prefetcher &prefetcher);
+  void prefetchAt(off64_t offset, Prefetcher &prefetcher);
+  // decodes every object in the pack, index-pack style, on threads
+  // threads (0 for one per core).
+  // returns the number of objects that could not be decoded
+  uint32_t decodeAll(unsigned threads, const ObjectSink &sink);
+  // checks the pack against the idx, on threads threads (0 for one
+  // per core): the pack and idx trailer checksums, the crc32 of every
+  // entry's raw bytes and the sha1 of every decoded object.
+  // returns the number of problems found, each is reported on stderr
+  uint32_t verify(unsigned threads);
+  // bytes the i-th object takes up in the pack, header included.
+  // -1 if the pack has no .rev (see reverseIndex)
+  off64_t packedSize(uint32_t i);
+  int list();
+
+private:
+  PackIdxReader(const PackIdxReader&);
+  PackIdxReader& operator=(const PackIdxReader&);
+
+  struct PackObject {
+    PackObject(const ObjectId &id,
+	       obj_type_t t,
+	       off64_t offset,
+	       off64_t size) : id_(id),
+			       type_(t),
+			       entry_(offset),
+			       offset_(offset),
+			       size_(size) { }
+    const ObjectId &id() { return id_; }
+    void setId(const ObjectId &id) { id_ = id; }
+    void update(std::function<uint8_t(void) > br) {
+      uint8_t byte = br();
+      type_ = (obj_type_t)((byte>>4)&0x7);
+      size_ = (byte&0xf); // 0TTTSSSS 1SSSSSS 0SSSSSSS
+      int32_t sh=4;
+      bool cont = byte&0x80;
+      while (cont) {
+	if (sh + 7 > 63) {
+	  // more than a positive off64_t holds, a corrupt header
+	  type_ = OBJ_NONE;
+	  size_ = -1;
+	  return;
+	}
+	byte = br();
+	size_ |= ((off64_t)(byte&0x7f)<<sh);
+	sh += 7;
+	cont = (byte & 0x80);
+      }
+    }
+    // where the entry (its header) starts in the pack
+    off64_t entry() { return entry_; }
+    // where the data starts, right after the header
+    off64_t offset() { return offset_; }
+    obj_type_t type() { return type_; }
+    off64_t size() { return size_; }
+    void setOffset(off64_t o) { offset_ = o; }
+    void setSize(off64_t size) { size_ = size; }
+    void setType(obj_type_t t) { type_ = t; }
+
+  private:
+    ObjectId id_;
+    obj_type_t type_;
+    off64_t entry_;
+    off64_t offset_;
+    off64_t size_;
+  };
+
+  // idx v2 layout, after the 8 byte header
+  //   256 x 4 byte fanout table, entry n has the number of objects
+  //                              whose first sha1 byte is <= n
+  //   N x 20 byte sorted sha1s
+  //   N x 4 byte crc32s
+  //   N x 4 byte offsets
+  //   M x 8 byte offsets, for the offsets with the MSB set
+  //   pack checksum, idx checksum
+  enum : off64_t {
+    kFanoutOffset = 8,
+    kSha1Offset = kFanoutOffset + 256*sizeof(uint32_t),
+  };
+
+  enum {
+    kSha1Table,
+    kCrc32Table,
+    kOffsetTable,
+    kLargeOffsetTable,
+  };
+
+  // the per lookup state. a mapping is not thread safe, each cursor
+  // has its own view of the pack (without an fd of its own, the
+  // windows underneath are shared)
+  struct Cursor {
+    Cursor(int fd) : pack(fd, MemoryMappedFile::kPackWindow, false) { }
+    MemoryMappedFile pack;
+    // inflated objects land here, reused across lookups
+    std::vector<uint8_t> scratch;
+    // same for inflated deltas
+    std::vector<uint8_t> delta;
+  };
+
+  // borrows an idle cursor (or a new one) for the lifetime of the lease
+  struct Lease {
+    Lease(PackIdxReader &reader);
+    ~Lease();
+    Cursor *operator->() { return cursor; }
+    PackIdxReader &reader;
+    Cursor *cursor;
+  };
+
+  enum : size_t {
+    // git's own limit is 4095 (pack.depth), anything longer
+    // than that is likely a cycle in a corrupt pack
+    kMaxDeltaChain = 10000,
+    // read ahead of an entry whose end is unknown
+    kPrefetchGuess = 64 << 10,
+  };
+
+  uint32_t fanout(int n);
+  uint32_t crc32(uint32_t i);
+  off64_t tableOffset(int table);
+  off64_t packOffset(uint32_t i);
+  PackObject object(MemoryMappedFile &pack, uint32_t i);
+  PackObject objectAt(MemoryMappedFile &pack, off64_t offset);
+  off64_t deltaBase(MemoryMappedFile &pack, PackObject &po, off64_t &data);
+  // the reverse index, read from the .rev if there is one. without
+  // a .rev it is only built (sorting every offset) when build is
+  // set, a handful of lookups aren't worth it. nullptr if not built
+  PackReverseIndex *reverseIndex(bool build);
+  // where the entry starting at offset ends, -1 if unknown
+  off64_t entryEnd(off64_t entry);
+  // compressed length of the stream at data, of the entry starting
+  // at entry. -1 if unknown
+  off64_t streamLength(off64_t entry, off64_t data);
+  bool unpack(Cursor &c, off64_t offset, obj_type_t &type,
+	      std::vector<uint8_t> &out);
+  ssize_t populate();
+  int setupPackedFd();
+  ssize_t readBytes(void *bytes, off64_t num);
+
+  std::string file_name_;
+  off64_t cursor_;
+  MemoryMappedFile idx_;
+  off64_t len_;
+  const uint8_t *addr_;
+  bool init_check_;
+  int packed_fd_;
+  off64_t pack_size_;
+  uint32_t entries_;
+  std::string rev_name_;
+  bool has_rev_file_;
+  // protects rev_ while it is being set up
+  std::mutex rev_lock_;
+  std::unique_ptr<PackReverseIndex> rev_;
+  DeltaBaseCache &delta_cache_;
+  std::mutex cursors_lock_;
+  // idle cursors
+  std::vector<std::unique_ptr<Cursor> > cursors_;
+};
+
+}
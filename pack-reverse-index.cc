@@ -0,0 +1,92 @@
+// on https://git-scm.com/docs/gitformat-pack#_pack_rev_files_have_the_format
+
+#include <iostream>
+#include <sys/fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include "pack-reverse-index.h"
+
+namespace fusism {
+
+PackReverseIndex::PackReverseIndex(const std::string &rev_file,
+				   uint32_t entries,
+				   const uint8_t *pack_checksum,
+				   const std::function<off64_t(uint32_t)> &offset)
+  : entries_(entries),
+    offset_(offset),
+    rev_(-1),
+    table_(nullptr) {
+  if (load(rev_file, pack_checksum)) {
+    return;
+  }
+  // no (usable) .rev, sort the idx positions by offset instead
+  std::vector<std::pair<off64_t, uint32_t> > by_offset(entries_);
+  for (uint32_t i=0; i<entries_; ++i) {
+    by_offset[i] = std::make_pair(offset_(i), i);
+  }
+  std::sort(by_offset.begin(), by_offset.end());
+  built_.resize(entries_);
+  for (uint32_t k=0; k<entries_; ++k) {
+    built_[k] = by_offset[k].second;
+  }
+}
+
+bool PackReverseIndex::load(const std::string &rev_file,
+			    const uint8_t *pack_checksum) {
+  int fd = open(rev_file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  rev_ = MemoryMappedFile(fd, MemoryMappedFile::kWholeFile);
+  off64_t len = rev_.size();
+  if (len != kHeaderSize + (off64_t)entries_*4 + 2*20) {
+    std::cerr << rev_file << " size doesn't match the idx\n";
+    return false;
+  }
+  const uint8_t *addr = rev_.span(0, len);
+  if (addr == nullptr) {
+    return false;
+  }
+  uint32_t version, hash;
+  memcpy(&version, addr + 4, sizeof(version));
+  memcpy(&hash, addr + 8, sizeof(hash));
+  if (memcmp(addr, "RIDX", 4) || ntohl(version) != 1 || ntohl(hash) != 1) {
+    std::cerr << rev_file << " not a sha1 v1 reverse index\n";
+    return false;
+  }
+  // a .rev left behind by an older pack of the same name
+  if (memcmp(addr + len - 2*20, pack_checksum, 20)) {
+    std::cerr << rev_file << " is for another pack\n";
+    return false;
+  }
+  table_ = addr + kHeaderSize;
+  return true;
+}
+
+uint32_t PackReverseIndex::at(uint32_t pos) {
+  if (table_ != nullptr) {
+    uint32_t v;
+    memcpy(&v, table_ + (off64_t)pos*4, sizeof(v));
+    return ntohl(v);
+  }
+  return built_[pos];
+}
+
+int64_t PackReverseIndex::find(off64_t offset) {
+  uint32_t lo = 0;
+  uint32_t hi = entries_;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo)/2;
+    off64_t o = offset_(at(mid));
+    if (o == offset) return mid;
+    if (o < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return -1;
+}
+
+}
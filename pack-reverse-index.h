@@ -0,0 +1,55 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "memory-mapped-file.h"
+
+namespace fusism {
+
+// the objects of a pack in pack order: at(k) is the idx position of
+// the k-th object in the pack. as entries are laid out back to back,
+// the entry after an object is where its compressed data ends.
+// read from the .rev next to the pack when there is one, otherwise
+// built from the idx offsets (the way git does without a .rev)
+struct PackReverseIndex {
+  // offset(i) is the pack offset of the i-th idx entry.
+  // pack_checksum is the checksum of the pack, as found in the idx
+  PackReverseIndex(const std::string &rev_file, uint32_t entries,
+		   const uint8_t *pack_checksum,
+		   const std::function<off64_t(uint32_t)> &offset);
+
+  uint32_t count() { return entries_; }
+  uint32_t at(uint32_t pos);
+  // position in pack order of the entry at offset, -1 if no
+  // entry starts there
+  int64_t find(off64_t offset);
+  // true if the .rev file is used
+  bool mapped() { return table_ != nullptr; }
+
+private:
+  PackReverseIndex(const PackReverseIndex&);
+  PackReverseIndex& operator=(const PackReverseIndex&);
+
+  // 12 byte header
+  //   4 byte signature RIDX
+  //   4 byte version (1)
+  //   4 byte hash function (1 is sha1)
+  // N x 4 byte idx positions, sorted by pack offset
+  // pack checksum, rev checksum
+  enum : off64_t {
+    kHeaderSize = 12,
+  };
+
+  bool load(const std::string &rev_file, const uint8_t *pack_checksum);
+
+  uint32_t entries_;
+  std::function<off64_t(uint32_t)> offset_;
+  MemoryMappedFile rev_;
+  const uint8_t *table_;
+  std::vector<uint32_t> built_;
+};
+
+}
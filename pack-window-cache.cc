@@ -0,0 +1,156 @@
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "pack-window-cache.h"
+
+namespace fusism {
+
+PackWindowCache& PackWindowCache::instance() {
+  static PackWindowCache cache;
+  return cache;
+}
+
+PackWindowCache::PackWindowCache() : limit_(kDefaultLimit),
+				     mapped_(0) { }
+
+PackWindowCache::~PackWindowCache() {
+  for (auto &w : windows_) {
+    munmap(w.addr, w.len);
+  }
+}
+
+PackWindowCache::Window *
+PackWindowCache::acquire(const FileKey &key, int fd,
+			 off64_t offset, off64_t len, off64_t window) {
+  if (offset < 0 || len <= 0 || offset + len > key.size) {
+    return nullptr;
+  }
+  if (window < 0) {
+    // the caller won't map again, a smaller window won't do
+    offset = 0;
+    len = key.size;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  auto file = files_.find(key);
+  if (file != files_.end()) {
+    // windows starting at or before offset, nearest first. none
+    // starting more than max_len before offset can cover it
+    auto &index = file->second.by_begin;
+    auto it = index.upper_bound(offset);
+    while (it != index.begin()) {
+      --it;
+      if (offset - it->first >= file->second.max_len) {
+	break;
+      }
+      auto w = it->second;
+      if (w->covers(offset, len)) {
+	w->refs += 1;
+	// most recently used at the back
+	windows_.splice(windows_.end(), windows_, w);
+	return &*w;
+      }
+    }
+  }
+
+  // map at page boundary before offset, making sure
+  // that the window covers [offset, offset+len)
+  long page_sz = sysconf(_SC_PAGESIZE);
+  off64_t begin = (offset/page_sz)*page_sz;
+  off64_t want = (offset - begin) + len;
+  if (window < 0) {
+    begin = 0;
+    want = key.size;
+  } else {
+    want = std::max(want, window);
+  }
+  want = std::min(key.size - begin, want);
+
+  evict(want);
+  uint8_t *addr = (uint8_t *)mmap(NULL, want, PROT_READ,
+				  MAP_PRIVATE, fd, begin);
+  if (addr == MAP_FAILED) {
+    // drop everything unused and try once more
+    evict(limit_);
+    addr = (uint8_t *)mmap(NULL, want, PROT_READ,
+			   MAP_PRIVATE, fd, begin);
+    if (addr == MAP_FAILED) {
+      perror("mmap");
+      return nullptr;
+    }
+  }
+  mapped_ += want;
+  windows_.push_back(Window{key, begin, want, addr, 1});
+  FileWindows &fw = files_[key];
+  if (fw.by_begin.empty() || want > fw.max_len) {
+    fw.max_len = want;
+  }
+  fw.by_begin.insert(std::make_pair(begin, std::prev(windows_.end())));
+  return &windows_.back();
+}
+
+void PackWindowCache::release(Window *w) {
+  if (w == nullptr) return;
+  std::lock_guard<std::mutex> guard(lock_);
+  assert(w->refs > 0);
+  w->refs -= 1;
+  if (mapped_ > limit_) {
+    evict(0);
+  }
+}
+
+void PackWindowCache::setLimit(off64_t limit) {
+  std::lock_guard<std::mutex> guard(lock_);
+  limit_ = limit;
+  evict(0);
+}
+
+off64_t PackWindowCache::limit() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return limit_;
+}
+
+off64_t PackWindowCache::mapped() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return mapped_;
+}
+
+void PackWindowCache::evict(off64_t incoming) {
+  // the list is in LRU order, the first unreferenced window goes
+  auto it = windows_.begin();
+  while (mapped_ + incoming > limit_) {
+    while (it != windows_.end() && it->refs != 0) ++it;
+    if (it == windows_.end()) {
+      // everything is in use
+      return;
+    }
+    munmap(it->addr, it->len);
+    mapped_ -= it->len;
+    unindex(it);
+    it = windows_.erase(it);
+  }
+}
+
+void PackWindowCache::unindex(std::list<Window>::iterator w) {
+  auto file = files_.find(w->key);
+  if (file == files_.end()) {
+    return;
+  }
+  auto &index = file->second.by_begin;
+  auto range = index.equal_range(w->begin);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == w) {
+      index.erase(it);
+      break;
+    }
+  }
+  // max_len is left as is, it only bounds the lookups
+  if (index.empty()) {
+    files_.erase(file);
+  }
+}
+
+} //namespace fusism
@@ -0,0 +1,95 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace fusism {
+
+// process wide cache of mmap windows over files (mostly .pack and .idx).
+// windows are refcounted, unreferenced windows are kept around
+// and evicted in LRU order once the total mapped bytes exceed the limit.
+// windows are indexed by file and start offset, a lookup is a map
+// search rather than a walk over every window.
+// windows that are in use are never unmapped, so the limit can be
+// exceeded temporarily if all the windows are referenced.
+struct PackWindowCache {
+  // identifies the contents of a file independent of the fd used
+  // to open it. size and mtime guard against inode reuse.
+  struct FileKey {
+    dev_t dev;
+    ino_t ino;
+    off64_t size;
+    int64_t mtime_ns;
+    bool operator==(const FileKey &o) const {
+      return dev == o.dev && ino == o.ino &&
+	size == o.size && mtime_ns == o.mtime_ns;
+    }
+  };
+
+  struct FileKeyHash {
+    size_t operator()(const FileKey &k) const {
+      return std::hash<uint64_t>()(((uint64_t)k.dev << 32) ^ k.ino ^
+				   (uint64_t)k.mtime_ns);
+    }
+  };
+
+  struct Window {
+    FileKey key;
+    off64_t begin;
+    off64_t len;
+    uint8_t *addr;
+    uint32_t refs;
+    bool covers(off64_t offset, off64_t l) const {
+      return offset >= begin && offset + l <= begin + len;
+    }
+  };
+
+  enum : off64_t {
+    kDefaultLimit = 1LL << 30,
+  };
+
+  static PackWindowCache& instance();
+
+  // returns a referenced window of the file covering [offset, offset+len).
+  // if a new window has to be mapped, it is at least window bytes long
+  // (the whole file if window is negative, a window found in the
+  // cache then has to cover the whole file too).
+  // returns nullptr if the mapping fails.
+  Window *acquire(const FileKey &key, int fd,
+		  off64_t offset, off64_t len, off64_t window);
+  void release(Window *w);
+
+  void setLimit(off64_t limit);
+  off64_t limit();
+  off64_t mapped();
+
+private:
+  PackWindowCache();
+  ~PackWindowCache();
+  PackWindowCache(const PackWindowCache&);
+  PackWindowCache& operator=(const PackWindowCache&);
+
+  // the windows of one file by start offset. several windows may
+  // start at the same offset (a longer span was asked for later)
+  struct FileWindows {
+    std::multimap<off64_t, std::list<Window>::iterator> by_begin;
+    // the longest window, bounds how far back a lookup has to go
+    off64_t max_len;
+  };
+
+  // must be called with lock_ held
+  void evict(off64_t incoming);
+  void unindex(std::list<Window>::iterator w);
+
+  std::mutex lock_;
+  // least recently used first
+  std::list<Window> windows_;
+  std::unordered_map<FileKey, FileWindows, FileKeyHash> files_;
+  off64_t limit_;
+  off64_t mapped_;
+};
+
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+
+#include "git-object.h"
+#include "path-resolver.h"
+
+namespace fusism {
+
+  PathResolver::PathResolver(ObjectDatabase &odb,
+			     TreeCache &cache) : odb_(odb),
+						 cache_(cache),
+						 refs_(odb.path()) { }
+
+  bool PathResolver::resolve(const std::string &spec, ObjectId &id,
+			     uint32_t &mode) {
+    size_t colon = spec.find(':');
+    std::string rev = spec.substr(0, colon);
+    mode = 0;
+    if (!ObjectId::fromHex(rev.c_str(), id) && !refs_.resolve(rev, id)) {
+      return false;
+    }
+    if (colon == std::string::npos) {
+      return true;
+    }
+
+    // one directory at a time, each a binary search in a cached tree
+    std::string path = spec.substr(colon + 1);
+    ObjectId root;
+    TreeCache::TreePtr dir = tree(id, &root);
+    if (dir == nullptr) {
+      return false;
+    }
+    id = root;
+    mode = 040000;
+    size_t pos = 0;
+    while (pos < path.size()) {
+      size_t slash = path.find('/', pos);
+      if (slash == std::string::npos) slash = path.size();
+      if (slash == pos) {
+	// a//b and a trailing / are fine
+	pos++;
+	continue;
+      }
+      if (dir == nullptr) {
+	// the last component was not a tree
+	return false;
+      }
+      const Tree::Entry *e = dir->find(path.data() + pos, slash - pos);
+      if (e == nullptr) {
+	return false;
+      }
+      id = e->id;
+      mode = e->mode;
+      dir = e->isTree() ? tree(id) : nullptr;
+      if (e->isTree() && dir == nullptr) {
+	return false;
+      }
+      pos = slash + 1;
+    }
+    return true;
+  }
+
+  TreeCache::TreePtr PathResolver::tree(const ObjectId &start, ObjectId *tree_id) {
+    ObjectId id = start;
+    for (int peel=0; peel<kMaxPeel; peel++) {
+      TreeCache::TreePtr cached = cache_.get(id);
+      if (cached != nullptr) {
+	if (tree_id != nullptr) *tree_id = id;
+	return cached;
+      }
+      obj_type_t type;
+      if (!odb_.read(id, type, scratch_)) {
+	return nullptr;
+      }
+      ObjectId next;
+      switch (type) {
+      case OBJ_TREE: {
+	std::shared_ptr<Tree> t(new Tree());
+	if (!t->parse(std::move(scratch_))) {
+	  std::cerr << id.hex() << " bad tree\n";
+	  return nullptr;
+	}
+	scratch_ = std::vector<uint8_t>();
+	cache_.put(id, t);
+	if (tree_id != nullptr) *tree_id = id;
+	return t;
+      }
+      case OBJ_COMMIT:
+	if (!commitTree(scratch_.data(), scratch_.size(), next)) return nullptr;
+	break;
+      case OBJ_TAG:
+	if (!tagObject(scratch_.data(), scratch_.size(), next)) return nullptr;
+	break;
+      default:
+	return nullptr;
+      }
+      id = next;
+    }
+    return nullptr;
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "object-database.h"
+#include "object-id.h"
+#include "refs.h"
+#include "tree-cache.h"
+
+namespace fusism {
+  // resolves <rev>:<path> (e.g HEAD:src/main.c) to the id of the
+  // object at path, walking commit, tree, subtrees down to the entry.
+  // rev is a sha1 or a ref name, annotated tags are peeled. a bare
+  // <rev> is the object itself, <rev>: is its root tree.
+  // trees come from the cache, shared with other resolvers (and
+  // threads). a resolver itself is not thread safe, like its odb
+  struct PathResolver {
+    PathResolver(ObjectDatabase &odb, TreeCache &cache);
+    // mode is set to the mode of the tree entry, 0 if there
+    // is no path
+    bool resolve(const std::string &spec, ObjectId &id, uint32_t &mode);
+    // the parsed tree id, from the cache if it is there.
+    // commits (and tags) are peeled down to their tree, whose id
+    // goes to tree_id
+    TreeCache::TreePtr tree(const ObjectId &id, ObjectId *tree_id=nullptr);
+  private:
+    PathResolver(const PathResolver&);
+    PathResolver& operator=(const PathResolver&);
+
+    enum { kMaxPeel = 16 };
+
+    ObjectDatabase &odb_;
+    TreeCache &cache_;
+    Refs refs_;
+    std::vector<uint8_t> scratch_;
+  };
+}
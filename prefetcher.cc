@@ -0,0 +1,204 @@
+#include <iostream>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "prefetcher.h"
+
+namespace fusism {
+namespace {
+  // no liburing, the two syscalls needed are simple enough
+  int ioUringSetup(unsigned entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+  }
+
+  int ioUringEnter(int fd, unsigned submit, unsigned min, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, submit, min, flags, nullptr, 0);
+  }
+
+  unsigned loadAcquire(unsigned *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+  }
+
+  void storeRelease(unsigned *p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+  }
+}
+
+  Prefetcher::Prefetcher(Backend backend, unsigned depth) : backend_(backend),
+							    depth_(depth),
+							    ring_fd_(-1),
+							    inflight_(0),
+							    sq_ring_(MAP_FAILED),
+							    sq_ring_len_(0),
+							    cq_ring_(MAP_FAILED),
+							    cq_ring_len_(0),
+							    sqes_(MAP_FAILED),
+							    sqes_len_(0),
+							    stop_(false) {
+    if (backend_ == kAuto || backend_ == kIoUring) {
+      if (setupRing()) {
+	backend_ = kIoUring;
+	return;
+      }
+      // e.g seccomp filtered, or an old kernel
+      teardownRing();
+      backend_ = kReadahead;
+    }
+    if (backend_ == kReadahead) {
+      thread_ = std::thread(&Prefetcher::runReadahead, this);
+    }
+  }
+
+  Prefetcher::~Prefetcher() {
+    if (backend_ == kIoUring) {
+      // the fds must not go away under the outstanding hints
+      reap(inflight_);
+      teardownRing();
+    } else if (backend_ == kReadahead) {
+      {
+	std::lock_guard<std::mutex> l(lock_);
+	stop_ = true;
+      }
+      wake_.notify_one();
+      thread_.join();
+    }
+  }
+
+  const char *Prefetcher::backendName(Backend b) {
+    switch (b) {
+    case kAuto:
+      return "auto";
+    case kIoUring:
+      return "io_uring";
+    case kReadahead:
+      return "readahead";
+    default:
+      return "none";
+    }
+  }
+
+  void Prefetcher::prefetch(int fd, off64_t offset, off64_t len) {
+    if (fd < 0 || offset < 0 || len <= 0) {
+      return;
+    }
+    Request r = { fd, offset, std::min<off64_t>(len, kMaxRead) };
+    switch (backend_) {
+    case kIoUring:
+      if (inflight_ > 0) reap(0);
+      if (inflight_ < depth_) {
+	submit(r);
+      }
+      break;
+    case kReadahead: {
+      std::lock_guard<std::mutex> l(lock_);
+      if (queue_.size() >= depth_) {
+	// the reads are behind already, this one would be late
+	return;
+      }
+      queue_.push_back(r);
+      wake_.notify_one();
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  bool Prefetcher::setupRing() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd_ = ioUringSetup(depth_, &p);
+    if (ring_fd_ < 0) {
+      return false;
+    }
+    sq_ring_len_ = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    cq_ring_len_ = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    sqes_len_ = p.sq_entries*sizeof(struct io_uring_sqe);
+    sq_ring_ = mmap(nullptr, sq_ring_len_, PROT_READ|PROT_WRITE,
+		    MAP_SHARED|MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = mmap(nullptr, cq_ring_len_, PROT_READ|PROT_WRITE,
+		    MAP_SHARED|MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    sqes_ = mmap(nullptr, sqes_len_, PROT_READ|PROT_WRITE,
+		 MAP_SHARED|MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+      return false;
+    }
+    uint8_t *sq = static_cast<uint8_t *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    uint8_t *cq = static_cast<uint8_t *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    // the rings may be smaller than asked for
+    depth_ = std::min(depth_, p.sq_entries);
+    return true;
+  }
+
+  void Prefetcher::teardownRing() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_len_);
+    if (cq_ring_ != MAP_FAILED) munmap(cq_ring_, cq_ring_len_);
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_len_);
+    sqes_ = cq_ring_ = sq_ring_ = MAP_FAILED;
+    if (ring_fd_ >= 0) close(ring_fd_);
+    ring_fd_ = -1;
+  }
+
+  bool Prefetcher::submit(const Request &r) {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    // fadvise does not wait for the pages, it only starts the reads
+    sqe->opcode = IORING_OP_FADVISE;
+    sqe->fd = r.fd;
+    sqe->off = r.offset;
+    sqe->len = r.len;
+    sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+    sq_array_[index] = index;
+    storeRelease(sq_tail_, tail + 1);
+    if (ioUringEnter(ring_fd_, 1, 0, 0) != 1) {
+      // not taken, give the slot back
+      storeRelease(sq_tail_, tail);
+      return false;
+    }
+    inflight_++;
+    return true;
+  }
+
+  void Prefetcher::reap(unsigned min) {
+    while (min > 0 && ioUringEnter(ring_fd_, 0, min, IORING_ENTER_GETEVENTS) < 0 &&
+	   errno == EINTR) { }
+    unsigned head = *cq_head_;
+    unsigned tail = loadAcquire(cq_tail_);
+    // failed hints don't matter, the decoder will find out itself
+    inflight_ -= tail - head;
+    storeRelease(cq_head_, tail);
+  }
+
+  void Prefetcher::runReadahead() {
+    std::unique_lock<std::mutex> l(lock_);
+    for (;;) {
+      wake_.wait(l, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_) {
+	return;
+      }
+      Request r = queue_.front();
+      queue_.pop_front();
+      l.unlock();
+      // fills the page cache, waits for it unlike fadvise
+      (void)readahead(r.fd, r.offset, r.len);
+      l.lock();
+    }
+  }
+}
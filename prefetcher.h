@@ -0,0 +1,89 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fusism {
+  // asks the kernel to read file regions ahead of their use so they
+  // are in the page cache by the time the mapping touches them,
+  // instead of faulting them in one object at a time. only the page
+  // cache is filled, nothing is copied to user space.
+  // requests are hints: they never block the caller and are dropped
+  // when too many are outstanding. not thread safe, one thread
+  // queues the requests. fds must stay open until the prefetcher
+  // is destroyed
+  struct Prefetcher {
+    enum Backend {
+      // io_uring if the kernel allows it, readahead otherwise
+      kAuto,
+      // fadvise(WILLNEED) through io_uring
+      kIoUring,
+      // readahead(2) on a background thread
+      kReadahead,
+      kNone,
+    };
+
+    enum : size_t {
+      // requests outstanding at once
+      kDefaultDepth = 64,
+      // regions are hinted in pieces of at most this much
+      kMaxRead = 1 << 20,
+    };
+
+    Prefetcher(Backend backend=kAuto, unsigned depth=kDefaultDepth);
+    // waits for the outstanding hints
+    ~Prefetcher();
+    // queues [offset, offset+len) of fd to be read
+    void prefetch(int fd, off64_t offset, off64_t len);
+    // the backend actually in use
+    Backend backend() { return backend_; }
+    static const char *backendName(Backend b);
+  private:
+    Prefetcher(const Prefetcher&);
+    Prefetcher& operator=(const Prefetcher&);
+
+    struct Request {
+      int fd;
+      off64_t offset;
+      off64_t len;
+    };
+
+    // io_uring by hand, the raw syscalls and the shared rings
+    bool setupRing();
+    void teardownRing();
+    bool submit(const Request &r);
+    // reaps the completed hints, waiting for at least min of them
+    void reap(unsigned min);
+
+    void runReadahead();
+
+    Backend backend_;
+    unsigned depth_;
+
+    int ring_fd_;
+    unsigned inflight_;
+    void *sq_ring_;
+    size_t sq_ring_len_;
+    void *cq_ring_;
+    size_t cq_ring_len_;
+    void *sqes_;
+    size_t sqes_len_;
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned *sq_mask_;
+    unsigned *sq_array_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned *cq_mask_;
+
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::deque<Request> queue_;
+    bool stop_;
+    std::thread thread_;
+  };
+}
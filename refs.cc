@@ -0,0 +1,72 @@
+#include <fstream>
+
+#include "refs.h"
+
+namespace fusism {
+
+  Refs::Refs(std::string git_path) : git_path_(git_path),
+				     packed_loaded_(false) { }
+
+  bool Refs::resolve(const std::string &name, ObjectId &id) {
+    if (name.empty() || name.find("..") != std::string::npos) {
+      return false;
+    }
+    static const char *rules[] = {
+      "%s",
+      "refs/%s",
+      "refs/tags/%s",
+      "refs/heads/%s",
+      "refs/remotes/%s",
+      "refs/remotes/%s/HEAD",
+    };
+    for (auto rule : rules) {
+      std::string ref = rule;
+      ref.replace(ref.find("%s"), 2, name);
+      if (resolveRef(ref, id, 0)) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  bool Refs::resolveRef(const std::string &ref, ObjectId &id, int depth) {
+    if (depth > kMaxSymrefDepth) {
+      return false;
+    }
+    std::ifstream in(git_path_ + "/" + ref);
+    std::string line;
+    if (in && std::getline(in, line)) {
+      if (!line.compare(0, 5, "ref: ")) {
+	return resolveRef(line.substr(5), id, depth + 1);
+      }
+      return line.size() >= ObjectId::kHexSize &&
+	ObjectId::fromHex(line.c_str(), id, false);
+    }
+    loadPackedRefs();
+    auto it = packed_.find(ref);
+    if (it == packed_.end()) {
+      return false;
+    }
+    id = it->second;
+    return true;
+  }
+
+  // "<40 hex> <ref>" lines. the "^<40 hex>" lines with the commits
+  // annotated tags peel to are skipped, tags are peeled when walked
+  void Refs::loadPackedRefs() {
+    if (packed_loaded_) {
+      return;
+    }
+    packed_loaded_ = true;
+    std::ifstream in(git_path_ + "/packed-refs");
+    std::string line;
+    while (std::getline(in, line)) {
+      ObjectId id;
+      if (line.size() > ObjectId::kHexSize + 1 &&
+	  line[ObjectId::kHexSize] == ' ' &&
+	  ObjectId::fromHex(line.c_str(), id, false)) {
+	packed_[line.substr(ObjectId::kHexSize + 1)] = id;
+      }
+    }
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+
+#include "object-id.h"
+
+namespace fusism {
+  // resolves ref names (HEAD, master, v1.0, refs/heads/master...) to
+  // the object they point at, the way git rev-parse searches them:
+  // <name>, refs/<name>, refs/tags/<name>, refs/heads/<name>,
+  // refs/remotes/<name> and refs/remotes/<name>/HEAD. loose refs take
+  // precedence over packed-refs, which is read on first use
+  struct Refs {
+    // git_path is the .git directory
+    Refs(std::string git_path);
+    bool resolve(const std::string &name, ObjectId &id);
+  private:
+    // git's limit on symref chains
+    enum { kMaxSymrefDepth = 5 };
+
+    bool resolveRef(const std::string &ref, ObjectId &id, int depth);
+    void loadPackedRefs();
+
+    std::string git_path_;
+    bool packed_loaded_;
+    std::unordered_map<std::string, ObjectId> packed_;
+  };
+}
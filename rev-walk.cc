@@ -0,0 +1,176 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+#include "git-object.h"
+#include "rev-walk.h"
+
+namespace fusism {
+
+  RevWalk::RevWalk(ObjectDatabase &odb, CommitGraph &graph,
+		   PathResolver &trees) : odb_(odb),
+					  graph_(graph),
+					  trees_(trees),
+					  seq_(0),
+					  from_graph_(0),
+					  inflated_(0) {
+    // the commit-graph is left invalid when either is there
+    loadGrafts(odb_.path() + "/info/grafts");
+    loadGrafts(odb_.path() + "/shallow");
+  }
+
+  void RevWalk::loadGrafts(const std::string &file) {
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+      const char *p = line.c_str();
+      const char *end = p + line.size();
+      ObjectId id;
+      if (end - p < ObjectId::kHexSize || !ObjectId::fromHex(p, id, false)) {
+	// comments too
+	continue;
+      }
+      std::vector<ObjectId> &parents = grafts_[id];
+      parents.clear();
+      for (p+=ObjectId::kHexSize; end - p > ObjectId::kHexSize && *p == ' ';
+	   p+=ObjectId::kHexSize+1) {
+	ObjectId parent;
+	if (ObjectId::fromHex(p + 1, parent, false)) {
+	  parents.push_back(parent);
+	}
+      }
+    }
+  }
+
+  void RevWalk::limit(const std::string &path) {
+    // a/b/ is a/b, the resolver takes care of the rest
+    size_t end = path.find_last_not_of('/');
+    path_ = end == std::string::npos ? "" : path.substr(0, end + 1);
+  }
+
+  bool RevWalk::push(const ObjectId &start) {
+    ObjectId id = start;
+    for (int peel=0; peel<kMaxPeel; peel++) {
+      Commit c;
+      if (load(id, c)) {
+	enqueue(std::move(c), nullptr);
+	return true;
+      }
+      // maybe a tag
+      obj_type_t type;
+      if (!odb_.read(id, type, scratch_) || type != OBJ_TAG ||
+	  !tagObject(scratch_.data(), scratch_.size(), id)) {
+	return false;
+      }
+    }
+    return false;
+  }
+
+  bool RevWalk::load(const ObjectId &id, Commit &c) {
+    c.id = id;
+    int64_t pos = graph_.valid() ? graph_.find(id) : -1;
+    if (pos >= 0 && graph_.commit(pos, graph_commit_)) {
+      c.tree = graph_commit_.tree;
+      c.date = graph_commit_.date;
+      c.parents.clear();
+      for (auto p : graph_commit_.parents) {
+	c.parents.push_back(graph_.id(p));
+      }
+      from_graph_++;
+      return true;
+    }
+    obj_type_t type;
+    if (!odb_.read(id, type, scratch_) || type != OBJ_COMMIT ||
+	!parseCommit(scratch_.data(), scratch_.size(), c.tree, c.parents, c.date)) {
+      return false;
+    }
+    auto graft = grafts_.find(id);
+    if (graft != grafts_.end()) {
+      c.parents = graft->second;
+    }
+    inflated_++;
+    return true;
+  }
+
+  RevWalk::PathState RevWalk::pathState(const ObjectId &tree) {
+    PathState s;
+    if (!trees_.resolve(tree.hex() + ":" + path_, s.id, s.mode)) {
+      s.mode = 0;
+    }
+    return s;
+  }
+
+  void RevWalk::enqueue(Commit &&c, const PathState *state) {
+    if (!seen_.emplace(c.id, c.tree).second) {
+      return;
+    }
+    Entry e;
+    e.commit = std::move(c);
+    e.seq = seq_++;
+    e.known = state != nullptr;
+    if (state != nullptr) e.state = *state;
+    queue_.push_back(std::move(e));
+    std::push_heap(queue_.begin(), queue_.end(), Older());
+  }
+
+  bool RevWalk::next(Commit &c) {
+    while (!queue_.empty()) {
+      std::pop_heap(queue_.begin(), queue_.end(), Older());
+      Entry e = std::move(queue_.back());
+      queue_.pop_back();
+
+      // parents that can't be read (e.g a shallow clone) end the
+      // walk there
+      if (path_.empty()) {
+	for (auto &p : e.commit.parents) {
+	  Commit pc;
+	  // queued before through another child, not read again
+	  if (seen_.count(p) == 0 && load(p, pc)) enqueue(std::move(pc), nullptr);
+	}
+	c = std::move(e.commit);
+	return true;
+      }
+
+      PathState mine = e.known ? e.state : pathState(e.commit.tree);
+      std::vector<Commit> parents(e.commit.parents.size());
+      std::vector<PathState> states(parents.size());
+      bool show = true;
+      size_t same = 0;
+      for (size_t i=0; i<parents.size(); i++) {
+	auto known = seen_.find(e.commit.parents[i]);
+	if (known != seen_.end()) {
+	  // queued already, only its tree is needed to compare
+	  parents[i].id = known->first;
+	  parents[i].tree = known->second;
+	} else if (!load(e.commit.parents[i], parents[i])) {
+	  parents.resize(i);
+	  break;
+	}
+	states[i] = pathState(parents[i].tree);
+	if (states[i] == mine) {
+	  // nothing changed coming from this parent, history is
+	  // followed through it alone
+	  show = false;
+	  same = i;
+	  break;
+	}
+      }
+      if (e.commit.parents.empty()) {
+	// a root commit added whatever is there
+	show = mine.mode != 0;
+      }
+      if (!show && !parents.empty()) {
+	enqueue(std::move(parents[same]), &states[same]);
+      } else {
+	for (size_t i=0; i<parents.size(); i++) {
+	  enqueue(std::move(parents[i]), &states[i]);
+	}
+      }
+      if (show) {
+	c = std::move(e.commit);
+	return true;
+      }
+    }
+    return false;
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "commit-graph.h"
+#include "object-database.h"
+#include "object-id.h"
+#include "path-resolver.h"
+
+namespace fusism {
+  // walks history newest first: a priority queue of commits by
+  // committer date (ties in the order they were queued), and a seen
+  // set of ids so every commit is queued once. commits come from the
+  // commit-graph when it has them and are only inflated otherwise,
+  // with the parents info/grafts and shallow give them if any.
+  // with a path, only the commits changing it come out and history
+  // is simplified like git log -- path does: a merge that left the
+  // path as one of its parents had it is not shown, and only that
+  // parent is walked. not thread safe, like the odb
+  struct RevWalk {
+    struct Commit {
+      ObjectId id;
+      ObjectId tree;
+      std::vector<ObjectId> parents;
+      int64_t date;
+    };
+
+    // graph may be invalid (no commit-graph), trees is used to look
+    // the path up in the commits' trees
+    RevWalk(ObjectDatabase &odb, CommitGraph &graph, PathResolver &trees);
+    // restricts the walk to the commits changing path, see above
+    void limit(const std::string &path);
+    // starts from id, annotated tags are peeled. false if it is
+    // not a commit
+    bool push(const ObjectId &id);
+    // the next commit, newest first. false once the walk is over
+    bool next(Commit &c);
+
+    // commits read from the graph and inflated so far
+    uint64_t fromGraph() { return from_graph_; }
+    uint64_t inflated() { return inflated_; }
+  private:
+    RevWalk(const RevWalk&);
+    RevWalk& operator=(const RevWalk&);
+
+    enum { kMaxPeel = 16 };
+
+    // what is at the limiting path in a commit's tree, mode 0 if
+    // nothing
+    struct PathState {
+      ObjectId id;
+      uint32_t mode;
+
+      bool operator==(const PathState &o) const {
+	return mode == o.mode && (mode == 0 || id == o.id);
+      }
+    };
+
+    struct Entry {
+      Commit commit;
+      uint64_t seq;
+      bool known;
+      PathState state;
+    };
+
+    // orders the heap, the newest commit at the top
+    struct Older {
+      bool operator()(const Entry &a, const Entry &b) const {
+	if (a.commit.date != b.commit.date) return a.commit.date < b.commit.date;
+	return a.seq > b.seq;
+      }
+    };
+
+    // reads a grafts file, "<commit> <parent>..." per line. shallow
+    // has the commits alone, they lose their parents
+    void loadGrafts(const std::string &file);
+    bool load(const ObjectId &id, Commit &c);
+    PathState pathState(const ObjectId &tree);
+    // queues c unless it was seen before
+    void enqueue(Commit &&c, const PathState *state);
+
+    ObjectDatabase &odb_;
+    CommitGraph &graph_;
+    PathResolver &trees_;
+    std::string path_;
+    std::vector<Entry> queue_;
+    // every commit queued so far, with its tree
+    std::unordered_map<ObjectId, ObjectId> seen_;
+    std::unordered_map<ObjectId, std::vector<ObjectId> > grafts_;
+    uint64_t seq_;
+    CommitGraph::Commit graph_commit_;
+    std::vector<uint8_t> scratch_;
+    uint64_t from_graph_;
+    uint64_t inflated_;
+  };
+}
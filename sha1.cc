@@ -0,0 +1,41 @@
+#include <string>
+#include <openssl/evp.h>
+
+#include "sha1.h"
+
+namespace fusism {
+
+  Sha1::Sha1() : ctx_(EVP_MD_CTX_new()) {
+    reset();
+  }
+
+  Sha1::~Sha1() {
+    EVP_MD_CTX_free(ctx_);
+  }
+
+  void Sha1::reset() {
+    EVP_DigestInit_ex(ctx_, EVP_sha1(), nullptr);
+  }
+
+  void Sha1::update(const void *data, size_t len) {
+    EVP_DigestUpdate(ctx_, data, len);
+  }
+
+  ObjectId Sha1::final() {
+    ObjectId id;
+    unsigned int len = ObjectId::kRawSize;
+    EVP_DigestFinal_ex(ctx_, id.bytes, &len);
+    return id;
+  }
+
+  ObjectId Sha1::object(const char *type, const uint8_t *data, size_t len) {
+    std::string header = std::string(type) + " " + std::to_string(len);
+    // contexts are allocated, reuse one per thread
+    static thread_local Sha1 sha1;
+    sha1.reset();
+    // the NUL terminating the header is hashed too
+    sha1.update(header.c_str(), header.size() + 1);
+    sha1.update(data, len);
+    return sha1.final();
+  }
+}
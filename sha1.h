@@ -0,0 +1,29 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "object-id.h"
+
+struct evp_md_ctx_st;
+
+namespace fusism {
+  // incremental sha1, on top of libcrypto (which picks the sha
+  // extensions of the cpu when there are any)
+  struct Sha1 {
+    Sha1();
+    ~Sha1();
+    // starts over
+    void reset();
+    void update(const void *data, size_t len);
+    // the digest of everything since the last reset
+    ObjectId final();
+    // the id git gives an object: the sha1 of "<type> <size>\0"
+    // followed by the contents
+    static ObjectId object(const char *type, const uint8_t *data, size_t len);
+  private:
+    Sha1(const Sha1&);
+    Sha1& operator=(const Sha1&);
+
+    evp_md_ctx_st *ctx_;
+  };
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+# checks that --export can't be made to write outside of its directory,
+# neither by the tree nor by what is already in the directory.
+# needs git, run from the source directory: make check
+set -u
+
+pack_reader=$(pwd)/pack-reader
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failures=0
+
+check() {
+  if [ -n "$(ls -A "$tmp/escape")" ]; then
+    echo "FAIL: $1: written outside of the export"
+    ls -lA "$tmp/escape"
+    rm -rf "$tmp/escape"/*
+    failures=$((failures + 1))
+  else
+    echo "ok: $1"
+  fi
+}
+
+mkdir "$tmp/escape"
+git init -q "$tmp/repo"
+cd "$tmp/repo" || exit 1
+
+pwn=$(echo pwned | git hash-object -w --stdin)
+link=$(printf '%s' "$tmp/escape" | git hash-object -w --stdin)
+victim=$(printf '%s' "$tmp/escape/victim" | git hash-object -w --stdin)
+sub=$(printf '100644 blob %s\tpwned\n' "$pwn" | git mktree)
+
+# a symlink a and a tree a in the same tree, git fsck refuses those
+dup=$(printf '120000 blob %s\ta\n040000 tree %s\ta\n' "$link" "$sub" | git mktree)
+"$pack_reader" --export "$dup" "$tmp/out1" 1 >/dev/null 2>&1
+check "symlink and tree with the same name"
+
+# a symlink a in one tree, a tree a in the next, exported on top
+first=$(printf '120000 blob %s\ta\n' "$link" | git mktree)
+second=$(printf '040000 tree %s\ta\n' "$sub" | git mktree)
+"$pack_reader" --export "$first" "$tmp/out2" 1 >/dev/null 2>&1
+"$pack_reader" --export "$second" "$tmp/out2" 1 >/dev/null 2>&1
+check "tree over a symlink from an earlier export"
+if [ ! -f "$tmp/out2/a/pwned" ]; then
+  echo "FAIL: the tree did not replace the symlink"
+  failures=$((failures + 1))
+fi
+
+# files over symlinks and hard links to files outside
+echo keep > "$tmp/victim"
+file=$(printf '100644 blob %s\tb\n100644 blob %s\tc\n' "$pwn" "$pwn" | git mktree)
+mkdir "$tmp/out3"
+ln -s "$tmp/victim" "$tmp/out3/b"
+ln "$tmp/victim" "$tmp/out3/c"
+"$pack_reader" --export "$file" "$tmp/out3" 1 >/dev/null 2>&1
+if [ "$(cat "$tmp/victim")" != keep ]; then
+  echo "FAIL: written through a link"
+  failures=$((failures + 1))
+else
+  echo "ok: files over links"
+fi
+
+# a symlink over a symlink pointing outside
+over=$(printf '120000 blob %s\td\n' "$victim" | git mktree)
+mkdir "$tmp/out4"
+ln -s "$tmp/escape" "$tmp/out4/d"
+"$pack_reader" --export "$over" "$tmp/out4" 1 >/dev/null 2>&1
+check "symlink over a symlink"
+
+exit $failures
@@ -0,0 +1,102 @@
+#!/bin/sh
+# checks that objects are found through the idx's table of 8 byte
+# offsets: a pack indexed with a small offset limit, so that all but
+# its first object go through the table, and (with python3) a sparse
+# pack with an object past 4GiB.
+# needs git, run from the source directory: make check
+set -u
+
+pack_reader=$(pwd)/pack-reader
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failures=0
+
+export GIT_AUTHOR_NAME=check GIT_AUTHOR_EMAIL=check@localhost
+export GIT_COMMITTER_NAME=check GIT_COMMITTER_EMAIL=check@localhost
+
+git init -q "$tmp/small"
+cd "$tmp/small" || exit 1
+for i in 1 2 3; do
+  seq "$i" 500 > "f$i"
+  git add "f$i"
+  git commit -qm "$i"
+done
+git repack -adq
+pack=$(ls .git/objects/pack/*.pack)
+rm "${pack%.pack}.idx"
+# offsets past 12 (the first entry) go to the 8 byte table
+git index-pack --index-version=2,12 "$pack" >/dev/null
+git rev-list --all --objects | cut -c1-40 > "$tmp/ids"
+git cat-file --batch < "$tmp/ids" > "$tmp/expected"
+"$pack_reader" --batch < "$tmp/ids" > "$tmp/out" 2>/dev/null
+if cmp -s "$tmp/expected" "$tmp/out"; then
+  echo "ok: objects through 8 byte offsets"
+else
+  echo "FAIL: objects through 8 byte offsets"
+  failures=$((failures + 1))
+fi
+
+if ! command -v python3 >/dev/null; then
+  echo "skipped: pack over 4GiB, no python3"
+  exit $failures
+fi
+
+# two blobs, the second 5GiB into the pack. the gap is a hole in a
+# sparse file and the pack checksum is left zero, nothing reads them
+git init -q "$tmp/large"
+cd "$tmp/large" || exit 1
+python3 - .git/objects/pack > "$tmp/ids" <<'EOF'
+import hashlib, struct, sys, zlib
+
+far = 5 << 30
+blobs = [(12, b"near\n"), (far, b"far away\n")]
+entries = []
+for offset, data in blobs:
+    sha = hashlib.sha1(b"blob %d\0" % len(data) + data).digest()
+    # type 3 (blob), sizes below 16 fit the first byte
+    entry = bytes([0x30 | len(data)]) + zlib.compress(data)
+    entries.append((sha, offset, entry))
+    print(sha.hex())
+
+name = sys.argv[1] + "/pack-" + "0" * 40
+with open(name + ".pack", "wb") as pack:
+    pack.write(b"PACK" + struct.pack(">II", 2, len(entries)))
+    for sha, offset, entry in entries:
+        pack.seek(offset)
+        pack.write(entry)
+    pack.write(b"\0" * 20)
+
+idx = b"\377tOc" + struct.pack(">I", 2)
+entries.sort()
+idx += b"".join(struct.pack(">I", sum(1 for e in entries if e[0][0] <= n))
+                for n in range(256))
+idx += b"".join(e[0] for e in entries)
+idx += b"".join(struct.pack(">I", zlib.crc32(e[2])) for e in entries)
+large = []
+for sha, offset, entry in entries:
+    if offset < 1 << 31:
+        idx += struct.pack(">I", offset)
+    else:
+        idx += struct.pack(">I", 0x80000000 | len(large))
+        large.append(offset)
+idx += b"".join(struct.pack(">Q", o) for o in large)
+idx += b"\0" * 20
+idx += hashlib.sha1(idx).digest()
+with open(name + ".idx", "wb") as f:
+    f.write(idx)
+EOF
+if [ $? -ne 0 ]; then
+  echo "FAIL: the sparse pack could not be written"
+  exit $((failures + 1))
+fi
+printf '%s blob 5\nnear\n\n%s blob 9\nfar away\n\n' \
+  $(cat "$tmp/ids") > "$tmp/expected"
+"$pack_reader" --batch < "$tmp/ids" > "$tmp/out" 2>/dev/null
+if cmp -s "$tmp/expected" "$tmp/out"; then
+  echo "ok: object past 4GiB"
+else
+  echo "FAIL: object past 4GiB"
+  failures=$((failures + 1))
+fi
+
+exit $failures
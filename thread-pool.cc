@@ -0,0 +1,112 @@
+#include <algorithm>
+#include "thread-pool.h"
+
+namespace fusism {
+namespace {
+  thread_local ThreadPool *current_pool = nullptr;
+  thread_local int current_worker = -1;
+}
+
+  ThreadPool::ThreadPool(unsigned threads) : queued_(0),
+					     pending_(0),
+					     stop_(false),
+					     next_(0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i=0; i<threads; i++) {
+      queues_.emplace_back(new Queue());
+    }
+    for (unsigned i=0; i<threads; i++) {
+      workers_.emplace_back(&ThreadPool::run, this, i);
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    wait();
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &w : workers_) {
+      w.join();
+    }
+  }
+
+  int ThreadPool::currentWorker() {
+    return current_pool == this ? current_worker : -1;
+  }
+
+  void ThreadPool::submit(Task task) {
+    int self = currentWorker();
+    unsigned q = self >= 0 ? self : next_++ % queues_.size();
+    {
+      // counted before any worker can see it: a thief finishing it
+      // first would otherwise take pending_ to 0 under wait()
+      std::lock_guard<std::mutex> guard(lock_);
+      queued_ += 1;
+      pending_ += 1;
+    }
+    {
+      std::lock_guard<std::mutex> guard(queues_[q]->lock);
+      queues_[q]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+  }
+
+  void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lk(lock_);
+    idle_.wait(lk, [this] { return pending_ == 0; });
+  }
+
+  bool ThreadPool::pop(unsigned self, Task &task) {
+    {
+      // own work first, newest first
+      Queue &q = *queues_[self];
+      std::lock_guard<std::mutex> guard(q.lock);
+      if (!q.tasks.empty()) {
+	task = std::move(q.tasks.back());
+	q.tasks.pop_back();
+	return true;
+      }
+    }
+    // then steal the oldest task of somebody else
+    for (unsigned i=1; i<queues_.size(); i++) {
+      Queue &q = *queues_[(self + i) % queues_.size()];
+      std::lock_guard<std::mutex> guard(q.lock);
+      if (!q.tasks.empty()) {
+	task = std::move(q.tasks.front());
+	q.tasks.pop_front();
+	return true;
+      }
+    }
+    return false;
+  }
+
+  void ThreadPool::run(unsigned self) {
+    current_pool = this;
+    current_worker = self;
+    while (true) {
+      Task task;
+      if (pop(self, task)) {
+	{
+	  std::lock_guard<std::mutex> guard(lock_);
+	  queued_ -= 1;
+	}
+	task();
+	std::lock_guard<std::mutex> guard(lock_);
+	pending_ -= 1;
+	if (pending_ == 0) {
+	  idle_.notify_all();
+	}
+	continue;
+      }
+      std::unique_lock<std::mutex> lk(lock_);
+      wake_.wait(lk, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0) {
+	return;
+      }
+    }
+  }
+}
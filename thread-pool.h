@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fusism {
+  // fixed size work stealing thread pool. every worker has its own
+  // deque, tasks submitted from a worker go to the back of its deque
+  // and are picked up LIFO (depth first, the data they need is still
+  // hot), idle workers steal from the front of the others' deques.
+  // tasks submitted from outside are spread round robin
+  struct ThreadPool {
+    typedef std::function<void()> Task;
+
+    // threads == 0 uses one thread per core
+    ThreadPool(unsigned threads=0);
+    // waits for all the tasks to finish
+    ~ThreadPool();
+    void submit(Task task);
+    // blocks until every submitted task (and the tasks they
+    // submitted) has run
+    void wait();
+    unsigned size() { return workers_.size(); }
+    // index of the calling worker in its pool, -1 if the caller
+    // is not a worker of this pool
+    int currentWorker();
+  private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    struct Queue {
+      std::mutex lock;
+      std::deque<Task> tasks;
+    };
+
+    void run(unsigned self);
+    bool pop(unsigned self, Task &task);
+
+    std::vector<std::unique_ptr<Queue> > queues_;
+    std::vector<std::thread> workers_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    // tasks sitting in a queue, and tasks queued or running
+    size_t queued_;
+    size_t pending_;
+    bool stop_;
+    std::atomic<unsigned> next_;
+  };
+}
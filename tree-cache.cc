@@ -0,0 +1,108 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "tree-cache.h"
+
+namespace fusism {
+  int Tree::compareNames(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int cmp = memcmp(a, b, std::min(a_len, b_len));
+    if (cmp != 0) return cmp;
+    return a_len < b_len ? -1 : a_len > b_len;
+  }
+
+  bool Tree::parse(std::vector<uint8_t> &&data) {
+    data_ = std::move(data);
+    entries_.clear();
+    // "<octal mode> <name>\0<20 byte sha1>" back to back
+    const uint8_t *p = data_.data();
+    const uint8_t *end = p + data_.size();
+    while (p < end) {
+      const uint8_t *sp = static_cast<const uint8_t *>(memchr(p, ' ', end - p));
+      if (sp == nullptr) return false;
+      uint32_t mode = 0;
+      for (const uint8_t *m=p; m<sp; m++) {
+	if (*m < '0' || *m > '7') return false;
+	mode = (mode << 3) | (*m - '0');
+      }
+      const char *name = reinterpret_cast<const char *>(sp + 1);
+      const uint8_t *nul = static_cast<const uint8_t *>(memchr(sp + 1, '\0', end - sp - 1));
+      if (nul == nullptr || end - nul - 1 < ObjectId::kRawSize) return false;
+      Entry e;
+      e.name = name;
+      e.name_len = reinterpret_cast<const char *>(nul) - name;
+      e.mode = mode;
+      e.id = ObjectId::fromRaw(nul + 1);
+      entries_.push_back(e);
+      p = nul + 1 + ObjectId::kRawSize;
+    }
+    // mostly sorted already, only directories move around
+    std::sort(entries_.begin(), entries_.end(), [](const Entry &a, const Entry &b) {
+	return compareNames(a.name, a.name_len, b.name, b.name_len) < 0;
+      });
+    return true;
+  }
+
+  const Tree::Entry *Tree::find(const char *name, size_t len) const {
+    size_t lo = 0;
+    size_t hi = entries_.size();
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      const Entry &e = entries_[mid];
+      int cmp = compareNames(name, len, e.name, e.name_len);
+      if (cmp == 0) return &e;
+      if (cmp > 0) lo = mid + 1;
+      else hi = mid;
+    }
+    return nullptr;
+  }
+
+  size_t Tree::bytes() const {
+    return data_.capacity() + entries_.capacity()*sizeof(Entry) + sizeof(*this);
+  }
+
+  TreeCache::TreeCache(size_t limit) : limit_(limit), size_(0) { }
+
+  TreeCache::TreePtr TreeCache::get(const ObjectId &id) {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = index_.find(id);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->tree;
+  }
+
+  void TreeCache::put(const ObjectId &id, const TreePtr &tree) {
+    size_t bytes = tree->bytes();
+    if (bytes > limit_) {
+      return;
+    }
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = index_.find(id);
+    if (it != index_.end()) {
+      // trees are immutable, whatever is there is just as good
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+    }
+    lru_.push_front(Entry{id, tree});
+    index_[id] = lru_.begin();
+    size_ += bytes;
+    evict();
+  }
+
+  size_t TreeCache::size() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return size_;
+  }
+
+  void TreeCache::evict() {
+    while (size_ > limit_ && !lru_.empty()) {
+      Entry &victim = lru_.back();
+      size_ -= victim.tree->bytes();
+      index_.erase(victim.id);
+      lru_.pop_back();
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "object-id.h"
+
+namespace fusism {
+  // a parsed tree object. the entries point into the inflated object
+  // the tree keeps, and are sorted by name for binary search (git's
+  // own order sorts directories as if their name ended with a /)
+  struct Tree {
+    struct Entry {
+      const char *name;
+      size_t name_len;
+      uint32_t mode;
+      ObjectId id;
+
+      bool isTree() const { return (mode & 0170000) == 040000; }
+      // gitlinks, the commit of a submodule
+      bool isCommit() const { return (mode & 0170000) == 0160000; }
+    };
+
+    // parses an inflated tree object, false if it is malformed
+    bool parse(std::vector<uint8_t> &&data);
+    // the entry called name, nullptr if there is none
+    const Entry *find(const char *name, size_t len) const;
+    const std::vector<Entry> &entries() const { return entries_; }
+    // the order of entries(), <0, 0 or >0 like memcmp
+    static int compareNames(const char *a, size_t a_len, const char *b, size_t b_len);
+    // memory taken up, roughly
+    size_t bytes() const;
+  private:
+    std::vector<uint8_t> data_;
+    std::vector<Entry> entries_;
+  };
+
+  // size bounded LRU cache of parsed trees, keyed by their id. path
+  // lookups under the same directories parse each tree once.
+  // thread safe, the cached trees are immutable and shared
+  struct TreeCache {
+    typedef std::shared_ptr<const Tree> TreePtr;
+
+    enum : size_t {
+      kDefaultLimit = 32 << 20,
+    };
+
+    TreeCache(size_t limit=kDefaultLimit);
+    // returns the cached tree or nullptr
+    TreePtr get(const ObjectId &id);
+    void put(const ObjectId &id, const TreePtr &tree);
+    size_t size();
+  private:
+    TreeCache(const TreeCache&);
+    TreeCache& operator=(const TreeCache&);
+
+    struct Entry {
+      ObjectId id;
+      TreePtr tree;
+    };
+
+    // must be called with lock_ held
+    void evict();
+
+    std::mutex lock_;
+    // most recently used first
+    std::list<Entry> lru_;
+    std::unordered_map<ObjectId, std::list<Entry>::iterator> index_;
+    size_t limit_;
+    size_t size_;
+  };
+}
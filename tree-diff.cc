@@ -0,0 +1,117 @@
+#include <iostream>
+
+#include "tree-diff.h"
+
+namespace fusism {
+
+  TreeDiff::TreeDiff(PathResolver &trees) : trees_(trees) { }
+
+  bool TreeDiff::diff(const ObjectId &a, const ObjectId &b, const Sink &sink) {
+    ObjectId a_id, b_id;
+    TreeCache::TreePtr ta = trees_.tree(a, &a_id);
+    TreeCache::TreePtr tb = trees_.tree(b, &b_id);
+    if (ta == nullptr || tb == nullptr) {
+      std::cerr << (ta == nullptr ? a : b).hex() << " is not a tree\n";
+      return false;
+    }
+    if (a_id == b_id) {
+      return true;
+    }
+    std::string path;
+    return diffTrees(ta.get(), tb.get(), path, sink);
+  }
+
+  bool TreeDiff::diffTrees(const Tree *a, const Tree *b, std::string &path,
+			   const Sink &sink) {
+    static const std::vector<Tree::Entry> none;
+    const std::vector<Tree::Entry> &ea = a != nullptr ? a->entries() : none;
+    const std::vector<Tree::Entry> &eb = b != nullptr ? b->entries() : none;
+    size_t i = 0, j = 0;
+    while (i < ea.size() || j < eb.size()) {
+      int cmp;
+      if (i == ea.size()) {
+	cmp = 1;
+      } else if (j == eb.size()) {
+	cmp = -1;
+      } else {
+	cmp = Tree::compareNames(ea[i].name, ea[i].name_len,
+				 eb[j].name, eb[j].name_len);
+      }
+      if (cmp < 0) {
+	if (!one(kDeleted, ea[i++], path, sink)) return false;
+	continue;
+      }
+      if (cmp > 0) {
+	if (!one(kAdded, eb[j++], path, sink)) return false;
+	continue;
+      }
+
+      const Tree::Entry &x = ea[i++];
+      const Tree::Entry &y = eb[j++];
+      // the whole subtree is the same
+      if (x.id == y.id && x.mode == y.mode) {
+	continue;
+      }
+      if (x.isTree() != y.isTree()) {
+	// a file became a directory or the other way around
+	if (!one(kDeleted, x, path, sink) || !one(kAdded, y, path, sink)) {
+	  return false;
+	}
+	continue;
+      }
+      size_t len = path.size();
+      if (len > 0) path += '/';
+      path.append(y.name, y.name_len);
+      bool ok;
+      if (x.isTree()) {
+	TreeCache::TreePtr tx = trees_.tree(x.id);
+	TreeCache::TreePtr ty = trees_.tree(y.id);
+	if (tx == nullptr || ty == nullptr) {
+	  std::cerr << path << ": bad tree\n";
+	  return false;
+	}
+	ok = diffTrees(tx.get(), ty.get(), path, sink);
+      } else {
+	// a file became a symlink or a submodule, or the other way
+	bool typed = ((x.mode ^ y.mode) & 0170000) != 0;
+	ok = emit(typed ? kTypeChanged : kModified, path, &x, &y, sink);
+      }
+      path.resize(len);
+      if (!ok) return false;
+    }
+    return true;
+  }
+
+  bool TreeDiff::one(Status status, const Tree::Entry &e, std::string &path,
+		     const Sink &sink) {
+    size_t len = path.size();
+    if (len > 0) path += '/';
+    path.append(e.name, e.name_len);
+    bool ok;
+    if (e.isTree()) {
+      TreeCache::TreePtr t = trees_.tree(e.id);
+      if (t == nullptr) {
+	std::cerr << path << ": bad tree\n";
+	return false;
+      }
+      ok = status == kAdded ? diffTrees(nullptr, t.get(), path, sink) :
+	diffTrees(t.get(), nullptr, path, sink);
+    } else {
+      ok = status == kAdded ? emit(status, path, nullptr, &e, sink) :
+	emit(status, path, &e, nullptr, sink);
+    }
+    path.resize(len);
+    return ok;
+  }
+
+  bool TreeDiff::emit(Status status, const std::string &path,
+		      const Tree::Entry *a, const Tree::Entry *b,
+		      const Sink &sink) {
+    Change c = {
+      status, path,
+      a != nullptr ? a->mode : 0, b != nullptr ? b->mode : 0,
+      a != nullptr ? a->id : ObjectId(), b != nullptr ? b->id : ObjectId(),
+    };
+    return sink(c);
+  }
+}
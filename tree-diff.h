@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+#include "object-id.h"
+#include "path-resolver.h"
+#include "tree-cache.h"
+
+namespace fusism {
+  // the paths that differ between two trees. both entry lists are
+  // sorted by name and merge walked side by side, entries with the
+  // same id and mode are skipped without looking inside, so only
+  // the subtrees that changed are ever inflated. trees come through
+  // the resolver's cache, diffs against the same base reuse them.
+  // changes are handed out as they are found, in name order (plain
+  // byte order, not git's where a directory sorts as if it ended
+  // with a /). like its resolver, not thread safe
+  struct TreeDiff {
+    enum Status : char {
+      kAdded = 'A',
+      kDeleted = 'D',
+      kModified = 'M',
+      // same path, another kind of entry (file, symlink, submodule)
+      kTypeChanged = 'T',
+    };
+
+    struct Change {
+      Status status;
+      // relative to the diffed trees, / separated
+      const std::string &path;
+      // 0 and a null id on the side the path is not on
+      uint32_t old_mode;
+      uint32_t new_mode;
+      ObjectId old_id;
+      ObjectId new_id;
+    };
+    // returns false to stop the diff
+    typedef std::function<bool(const Change &)> Sink;
+
+    TreeDiff(PathResolver &trees);
+    // a and b are trees, or commits and tags that peel to one.
+    // false if one of the trees could not be read or sink stopped
+    bool diff(const ObjectId &a, const ObjectId &b, const Sink &sink);
+  private:
+    TreeDiff(const TreeDiff&);
+    TreeDiff& operator=(const TreeDiff&);
+
+    // either tree may be nullptr, everything in the other one is
+    // then added (or deleted). path is the directory of both, it
+    // is appended to and restored on the way down
+    bool diffTrees(const Tree *a, const Tree *b, std::string &path,
+		   const Sink &sink);
+    // a path on one side only, subtrees are listed file by file
+    bool one(Status status, const Tree::Entry &e, std::string &path,
+	     const Sink &sink);
+    // a non tree entry was changed
+    bool emit(Status status, const std::string &path, const Tree::Entry *a,
+	      const Tree::Entry *b, const Sink &sink);
+
+    PathResolver &trees_;
+  };
+}
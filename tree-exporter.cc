@@ -0,0 +1,247 @@
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "git-object.h"
+#include "path-resolver.h"
+#include "tree-exporter.h"
+
+namespace fusism {
+namespace {
+  bool safeName(const char *name, size_t len) {
+    if (len == 0 || memchr(name, '/', len) != nullptr ||
+	memchr(name, '\0', len) != nullptr) {
+      return false;
+    }
+    std::string n(name, len);
+    return n != "." && n != ".." && strcasecmp(n.c_str(), ".git") != 0;
+  }
+
+  bool writeAll(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::write(fd, data, len);
+      if (n < 0) {
+	if (errno == EINTR) continue;
+	return false;
+      }
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  // removes whatever is at name in dir unless it is a directory and
+  // keep_dir is set. a file may be a hard link or a symlink to
+  // something outside, it is replaced rather than written to
+  bool clear(int dir, const char *name, bool keep_dir) {
+    struct stat st;
+    if (fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+      return errno == ENOENT;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      // a directory in the way of a file goes only if it is empty
+      return keep_dir || unlinkat(dir, name, AT_REMOVEDIR) == 0;
+    }
+    return unlinkat(dir, name, 0) == 0 || errno == ENOENT;
+  }
+
+  // creates (or reuses) the directory name in dir and opens it.
+  // -1 with errno set if it can't be had without following a symlink
+  int openDir(int dir, const char *name) {
+    if (mkdirat(dir, name, 0777) < 0) {
+      if (errno != EEXIST || !clear(dir, name, true) ||
+	  (mkdirat(dir, name, 0777) < 0 && errno != EEXIST)) {
+	return -1;
+      }
+    }
+    // O_NOFOLLOW fails if a symlink took its place since
+    return openat(dir, name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+  }
+
+  bool uniqueNames(const Tree &tree) {
+    // entries are sorted by plain name, the same names are neighbours
+    const std::vector<Tree::Entry> &e = tree.entries();
+    for (size_t i=1; i<e.size(); i++) {
+      if (Tree::compareNames(e[i-1].name, e[i-1].name_len, e[i].name, e[i].name_len) == 0) {
+	return false;
+      }
+    }
+    return true;
+  }
+}
+
+  TreeExporter::Dir::~Dir() {
+    close(fd);
+  }
+
+  TreeExporter::TreeExporter(ObjectDatabase &odb,
+			     const std::string &dir,
+			     unsigned threads) : odb_(odb),
+						 dir_(dir),
+						 pool_(threads),
+						 failed_(0),
+						 files_(0),
+						 bytes_(0) {
+  }
+
+  void TreeExporter::addPrefix(const std::string &prefix) {
+    // a/b/ and /a/b are a/b
+    size_t begin = prefix.find_first_not_of('/');
+    size_t end = prefix.find_last_not_of('/');
+    if (begin == std::string::npos) {
+      // the root, that's everything
+      prefixes_.clear();
+      prefixes_.push_back("");
+      return;
+    }
+    prefixes_.push_back(prefix.substr(begin, end - begin + 1));
+  }
+
+  uint64_t TreeExporter::run(const ObjectId &tree) {
+    // the root may be a commit or a tag, peeled on this thread
+    TreeCache cache;
+    ObjectId root;
+    if (PathResolver(odb_, cache).tree(tree, &root) == nullptr) {
+      std::cerr << tree.hex() << " is not a tree\n";
+      return 1;
+    }
+    // dir itself is the caller's, it may well be a symlink
+    if (mkdir(dir_.c_str(), 0777) < 0 && errno != EEXIST) {
+      fail("", strerror(errno));
+      return failed_;
+    }
+    int fd = open(dir_.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd < 0) {
+      fail("", strerror(errno));
+      return failed_;
+    }
+    DirPtr top(new Dir(fd));
+    bool all = prefixes_.empty() || (prefixes_.size() == 1 && prefixes_[0].empty());
+    pool_.submit([this, root, top, all]() { exportTree(root, top, "", all); });
+    pool_.wait();
+    return failed_;
+  }
+
+  TreeExporter::Match TreeExporter::match(const std::string &path, bool is_tree) {
+    for (auto &p : prefixes_) {
+      if (path.size() >= p.size() && !path.compare(0, p.size(), p) &&
+	  (path.size() == p.size() || path[p.size()] == '/')) {
+	return kAll;
+      }
+      if (is_tree && p.size() > path.size() && !p.compare(0, path.size(), path) &&
+	  p[path.size()] == '/') {
+	return kDescend;
+      }
+    }
+    return kSkip;
+  }
+
+  void TreeExporter::fail(const std::string &path, const char *what) {
+    std::cerr << dir_ << "/" << path << ": " << what << "\n";
+    failed_++;
+  }
+
+  // path is where the tree goes, relative to dir_, dir is that
+  // directory. all is set once under a prefix
+  void TreeExporter::exportTree(const ObjectId &id, const DirPtr &dir,
+				const std::string &path, bool all) {
+    std::vector<uint8_t> data;
+    obj_type_t type;
+    std::shared_ptr<Tree> tree(new Tree());
+    if (!odb_.read(id, type, data) || type != OBJ_TREE ||
+	!tree->parse(std::move(data))) {
+      fail(path, "bad tree");
+      return;
+    }
+    if (!uniqueNames(*tree)) {
+      // which of the two wins would depend on the task order
+      fail(path, "duplicate names, tree skipped");
+      return;
+    }
+    for (auto &e : tree->entries()) {
+      std::string name(e.name, e.name_len);
+      std::string sub = path.empty() ? name : path + "/" + name;
+      if (!safeName(e.name, e.name_len)) {
+	fail(sub, "unsafe name skipped");
+	continue;
+      }
+      bool is_dir = e.isTree() || e.isCommit();
+      Match m = all ? kAll : match(sub, e.isTree());
+      if (m == kSkip) {
+	continue;
+      }
+      if (e.isCommit()) {
+	// the submodule's objects are in another repository
+	int fd = openDir(dir->fd, name.c_str());
+	if (fd < 0) {
+	  fail(sub, strerror(errno));
+	} else {
+	  close(fd);
+	}
+      } else if (is_dir) {
+	ObjectId sub_id = e.id;
+	bool sub_all = m == kAll;
+	pool_.submit([this, dir, name, sub_id, sub, sub_all]() {
+	    int fd = openDir(dir->fd, name.c_str());
+	    if (fd < 0) {
+	      fail(sub, strerror(errno));
+	      return;
+	    }
+	    exportTree(sub_id, DirPtr(new Dir(fd)), sub, sub_all);
+	  });
+      } else {
+	// the entry points into tree, which the task keeps alive
+	const Tree::Entry *entry = &e;
+	pool_.submit([this, tree, entry, dir, sub]() { exportBlob(*entry, dir, sub); });
+      }
+    }
+  }
+
+  void TreeExporter::exportBlob(const Tree::Entry &entry, const DirPtr &dir,
+				const std::string &path) {
+    std::string name(entry.name, entry.name_len);
+    obj_type_t type;
+    off64_t size;
+    if ((entry.mode & 0170000) == 0120000) {
+      // the blob is the link target
+      std::vector<uint8_t> target;
+      if (!odb_.read(entry.id, type, target) || type != OBJ_BLOB) {
+	fail(path, "bad symlink blob");
+	return;
+      }
+      target.push_back('\0');
+      if (!clear(dir->fd, name.c_str(), false) ||
+	  symlinkat(reinterpret_cast<const char *>(target.data()), dir->fd,
+		    name.c_str()) < 0) {
+	fail(path, strerror(errno));
+	return;
+      }
+      files_++;
+      return;
+    }
+
+    // executable or not, the rest is up to the umask like git does
+    mode_t mode = (entry.mode & 0111) ? 0777 : 0666;
+    int fd = -1;
+    if (clear(dir->fd, name.c_str(), false)) {
+      fd = openat(dir->fd, name.c_str(),
+		  O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC, mode);
+    }
+    if (fd < 0) {
+      fail(path, strerror(errno));
+      return;
+    }
+    ssize_t n = odb_.stream(entry.id, type, size, [&](const uint8_t *data, size_t len) -> bool {
+	return type == OBJ_BLOB && writeAll(fd, data, len);
+      });
+    if (close(fd) < 0 || n < 0 || type != OBJ_BLOB) {
+      fail(path, n < 0 || type != OBJ_BLOB ? "bad blob" : strerror(errno));
+      return;
+    }
+    files_++;
+    bytes_ += n;
+  }
+}
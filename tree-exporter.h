@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "object-database.h"
+#include "object-id.h"
+#include "thread-pool.h"
+#include "tree-cache.h"
+
+namespace fusism {
+  // writes out the files of a tree under a directory, a checkout
+  // without an index. every subtree and every blob is a task on a
+  // work stealing pool sharing one object database.
+  // file modes are kept (executable or not), symlinks become
+  // symlinks and submodules empty directories. existing entries are
+  // replaced, never written through. names git itself refuses (., ..,
+  // .git, anything with a /) are skipped and trees with the same name
+  // twice are not written. every entry is created relative to the fd
+  // of its directory, opened without following symlinks, so neither
+  // the tree nor what is already in dir can send a write outside of it
+  struct TreeExporter {
+    // threads == 0 uses one thread per core
+    TreeExporter(ObjectDatabase &odb, const std::string &dir,
+		 unsigned threads=0);
+    // only export the paths under prefix (relative to the tree).
+    // without prefixes everything is
+    void addPrefix(const std::string &prefix);
+    // exports tree (commits and tags are peeled). returns the
+    // number of entries that could not be written
+    uint64_t run(const ObjectId &tree);
+    uint64_t files() { return files_; }
+    uint64_t bytes() { return bytes_; }
+  private:
+    TreeExporter(const TreeExporter&);
+    TreeExporter& operator=(const TreeExporter&);
+
+    enum Match {
+      kSkip,
+      // an ancestor of a prefix, only the way down to it
+      kDescend,
+      kAll,
+    };
+
+    // an open directory, closed with the last task using it
+    struct Dir {
+      Dir(int fd) : fd(fd) {}
+      ~Dir();
+      int fd;
+    };
+    typedef std::shared_ptr<Dir> DirPtr;
+
+    // path is relative to the exported tree, no leading /
+    Match match(const std::string &path, bool is_tree);
+    void exportTree(const ObjectId &id, const DirPtr &dir,
+		    const std::string &path, bool all);
+    void exportBlob(const Tree::Entry &entry, const DirPtr &dir,
+		    const std::string &path);
+    void fail(const std::string &path, const char *what);
+
+    ObjectDatabase &odb_;
+    std::string dir_;
+    std::vector<std::string> prefixes_;
+    ThreadPool pool_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> files_;
+    std::atomic<uint64_t> bytes_;
+  };
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+
+#include "git-object.h"
+#include "path-resolver.h"
+#include "tree-grep.h"
+
+namespace fusism {
+
+  TreeGrep::TreeGrep(ObjectDatabase &odb, const std::string &needle,
+		     OutputBuffer &out, unsigned threads) : odb_(odb),
+							    matcher_(needle),
+							    out_(out),
+							    pool_(threads),
+							    matches_(0),
+							    failed_(false) {
+  }
+
+  int64_t TreeGrep::run(const ObjectId &tree) {
+    TreeCache cache;
+    ObjectId root;
+    if (PathResolver(odb_, cache).tree(tree, &root) == nullptr) {
+      std::cerr << tree.hex() << " is not a tree\n";
+      return -1;
+    }
+    pool_.submit([this, root]() { grepTree(root, ""); });
+    pool_.wait();
+    return failed_ ? -1 : matches_.load();
+  }
+
+  void TreeGrep::grepTree(const ObjectId &id, const std::string &path) {
+    std::vector<uint8_t> data;
+    obj_type_t type;
+    Tree tree;
+    if (!odb_.read(id, type, data) || type != OBJ_TREE ||
+	!tree.parse(std::move(data))) {
+      std::cerr << path << ": bad tree\n";
+      failed_ = true;
+      return;
+    }
+    for (auto &e : tree.entries()) {
+      // submodules are in another repository
+      if (e.isCommit()) {
+	continue;
+      }
+      std::string sub = path.empty() ? std::string(e.name, e.name_len) :
+	path + "/" + std::string(e.name, e.name_len);
+      ObjectId sub_id = e.id;
+      if (e.isTree()) {
+	pool_.submit([this, sub_id, sub]() { grepTree(sub_id, sub); });
+      } else {
+	pool_.submit([this, sub_id, sub]() { grepBlob(sub_id, sub); });
+      }
+    }
+  }
+
+  void TreeGrep::grepBlob(const ObjectId &id, const std::string &path) {
+    // the buffer stays with the thread, most blobs fit in what the
+    // previous ones left allocated
+    static thread_local std::vector<uint8_t> data;
+    obj_type_t type;
+    if (!odb_.read(id, type, data) || type != OBJ_BLOB) {
+      std::cerr << path << ": bad blob\n";
+      failed_ = true;
+      return;
+    }
+    const uint8_t *begin = data.data();
+    const uint8_t *end = begin + data.size();
+    const uint8_t *m = matcher_.find(begin, end);
+    if (m == nullptr) {
+      if (data.capacity() > kKeepBuffer) data = std::vector<uint8_t>();
+      return;
+    }
+
+    std::string found;
+    if (memchr(begin, '\0', std::min<size_t>(data.size(), kBinaryProbe)) != nullptr) {
+      found = "Binary file " + path + " matches\n";
+      matches_++;
+    } else {
+      // lines are numbered as the matches go, counting from where
+      // the previous one was found
+      uint64_t line = 1;
+      const uint8_t *counted = begin;
+      while (m != nullptr) {
+	const uint8_t *bol = m;
+	while (bol > counted && bol[-1] != '\n') bol--;
+	line += std::count(counted, bol, '\n');
+	const uint8_t *eol = static_cast<const uint8_t *>(memchr(m, '\n', end - m));
+	if (eol == nullptr) eol = end;
+	found += path;
+	found += ':';
+	found += std::to_string(line);
+	found += ':';
+	found.append(reinterpret_cast<const char *>(bol), eol - bol);
+	found += '\n';
+	matches_++;
+	if (eol == end) break;
+	counted = eol + 1;
+	line++;
+	m = matcher_.find(counted, end);
+      }
+    }
+    if (data.capacity() > kKeepBuffer) data = std::vector<uint8_t>();
+    std::lock_guard<std::mutex> guard(lock_);
+    out_.write(found.data(), found.size());
+  }
+}
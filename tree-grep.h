@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "literal-matcher.h"
+#include "object-database.h"
+#include "object-id.h"
+#include "output-buffer.h"
+#include "thread-pool.h"
+#include "tree-cache.h"
+
+namespace fusism {
+  // searches the blobs of a tree for a fixed string, without checking
+  // anything out. like TreeExporter every subtree and every blob is a
+  // task on a work stealing pool sharing one odb. each blob is
+  // inflated and searched on its worker, and its matches written out
+  // at once as path:line number:line (git grep -n). files come out in
+  // whatever order they are done. binary blobs (a NUL early on, as
+  // git decides) only get a "Binary file <path> matches"
+  struct TreeGrep {
+    // threads == 0 uses one thread per core
+    TreeGrep(ObjectDatabase &odb, const std::string &needle,
+	     OutputBuffer &out, unsigned threads=0);
+    // searches tree (commits and tags are peeled), paths are
+    // relative to it. returns the number of matching lines, -1 if
+    // something could not be read
+    int64_t run(const ObjectId &tree);
+  private:
+    TreeGrep(const TreeGrep&);
+    TreeGrep& operator=(const TreeGrep&);
+
+    enum : size_t {
+      // how far git looks for a NUL to call a file binary
+      kBinaryProbe = 8000,
+      // a thread's blob buffer is let go above this
+      kKeepBuffer = 64 << 20,
+    };
+
+    void grepTree(const ObjectId &id, const std::string &path);
+    void grepBlob(const ObjectId &id, const std::string &path);
+
+    ObjectDatabase &odb_;
+    LiteralMatcher matcher_;
+    OutputBuffer &out_;
+    // protects out_, a file's matches go out in one piece
+    std::mutex lock_;
+    ThreadPool pool_;
+    std::atomic<int64_t> matches_;
+    std::atomic<bool> failed_;
+  };
+}
@@ -6,89 +6,293 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <algorithm>
 
 #include "zlib.h"
 #include "z-file-inflater.h"
+#include "memory-mapped-file.h"
 
 #define ARRAY_SIZE(a) ((sizeof(a))/sizeof((a[0])))
 
+// avail_out is 32 bits wide, objects above 4GiB are inflated
+// into their buffer in steps of this much
+static const size_t kMaxRoom = 1UL << 30;
+// deflate never does better than this, a size claiming more than
+// the input can inflate to comes from a corrupt header
+static const off64_t kMaxRatio = 1032;
+
 namespace fusism {
+namespace {
+  // bump allocator backing the pooled streams. zlib allocates the
+  // inflate state and window once per stream, and pooled streams live
+  // as long as their thread, so blocks are only ever released all at
+  // once when the thread goes away
+  struct ZArena {
+    enum : size_t {
+      kBlock = 64 << 10,
+      kAlign = 16,
+    };
+
+    ZArena() : used_(0), block_len_(0) { }
+    ~ZArena() {
+      for (auto b : blocks_) free(b);
+    }
+
+    void *alloc(size_t bytes) {
+      bytes = (bytes + kAlign - 1) & ~(size_t)(kAlign - 1);
+      if (blocks_.empty() || block_len_ - used_ < bytes) {
+	size_t len = std::max<size_t>(kBlock, bytes);
+	void *b = malloc(len);
+	if (b == nullptr) return nullptr;
+	blocks_.push_back(b);
+	block_len_ = len;
+	used_ = 0;
+      }
+      void *p = static_cast<uint8_t *>(blocks_.back()) + used_;
+      used_ += bytes;
+      return p;
+    }
+
+    static voidpf zalloc(voidpf opaque, uInt items, uInt size) {
+      return static_cast<ZArena *>(opaque)->alloc((size_t)items*size);
+    }
+    static void zfree(voidpf, voidpf) { }
+
+  private:
+    std::vector<void *> blocks_;
+    size_t used_;
+    size_t block_len_;
+  };
+
+  // per thread pool of initialized z_streams. a stream goes back to
+  // the pool with inflateReset instead of another inflateInit/inflateEnd
+  // round, which saves the allocations (see inflate-bench for what
+  // that is worth)
+  struct ZStreamPool {
+    // borrows a stream for the lifetime of the lease
+    struct Lease {
+      Lease() : strm(local().acquire()) { }
+      ~Lease() {
+	if (strm != nullptr) local().release(strm);
+      }
+      z_stream *strm;
+    };
+
+    static ZStreamPool &local() {
+      static thread_local ZStreamPool pool;
+      return pool;
+    }
+
+    ~ZStreamPool() {
+      for (auto s : free_) {
+	(void)inflateEnd(s);
+	delete s;
+      }
+    }
+
+    z_stream *acquire() {
+      z_stream *s;
+      if (!free_.empty()) {
+	s = free_.back();
+	free_.pop_back();
+      } else {
+	s = new z_stream();
+	s->zalloc = &ZArena::zalloc;
+	s->zfree = &ZArena::zfree;
+	s->opaque = &arena_;
+	s->avail_in = 0;
+	s->next_in = Z_NULL;
+	if (inflateInit(s) != Z_OK) {
+	  delete s;
+	  return nullptr;
+	}
+      }
+      s->avail_in = 0;
+      s->next_in = Z_NULL;
+      return s;
+    }
+
+    void release(z_stream *s) {
+      if (inflateReset(s) == Z_OK) {
+	free_.push_back(s);
+      } else {
+	(void)inflateEnd(s);
+	delete s;
+      }
+    }
+
+  private:
+    ZArena arena_;
+    std::vector<z_stream *> free_;
+  };
+}
+
   ZFileInflater::ZFileInflater(int fd, off64_t offset,
-			       off64_t size) : fd_(fd),
-					       offset_(offset),
-					       size_(size) { }
+			       off64_t size,
+			       off64_t in_len) : map_(nullptr),
+						 fd_(fd),
+						 offset_(offset),
+						 size_(size),
+						 in_len_(in_len) { }
+
+  ZFileInflater::ZFileInflater(MemoryMappedFile &map, off64_t offset,
+			       off64_t size,
+			       off64_t in_len) : map_(&map),
+						 fd_(-1),
+						 offset_(offset),
+						 size_(size),
+						 in_len_(in_len) { }
 
   ZFileInflater::~ZFileInflater() { }/*caller has close fd*/
 
-  int ZFileInflater::inflate() {
-    uint8_t input[1024];
-    uint8_t out[17];
-    char tmplate[16]={0};
-    snprintf(tmplate, sizeof(tmplate), "%s",
-	     "/tmp/catXXXXXX");
-    z_stream strm;
-    int ret;
+  ssize_t ZFileInflater::inflate(uint8_t *buf, size_t len) {
+    // a zero sized object still has a zlib stream to consume
+    uint8_t empty;
+    if (len == 0) buf = &empty;
+    // zlib only sees (at most) kMaxRoom of buf at a time, hand out the
+    // rest as it fills up. a stream larger than len shows up as
+    // Z_BUF_ERROR with no room left
+    return pump(buf, len, [&](z_stream &s, bool) -> bool {
+	size_t written = s.next_out - buf;
+	s.avail_out = std::min<size_t>(len - written, kMaxRoom);
+	return true;
+      });
+  }
 
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.avail_in = 0;
-    strm.next_in = Z_NULL;
-    if (inflateInit(&strm) != Z_OK) {
-      std::cerr << "failed to initiaze z_stream\n";
+  ssize_t ZFileInflater::inflate(std::vector<uint8_t> &out) {
+    if (size_ != -1) {
+      // checked before anything is allocated for it
+      if (!sizeFits()) {
+	out.clear();
+	return -1;
+      }
+      out.resize(size_);
+      ssize_t n = inflate(out.data(), size_);
+      if (n < 0) out.clear();
+      return n;
+    }
+
+    // size unknown (e.g loose objects), grow as we go
+    out.resize(std::max<size_t>(out.capacity(), 4096));
+    ssize_t n = pump(out.data(), out.size(),
+		     [&](z_stream &s, bool eos) -> bool {
+	if (!eos && s.avail_out == 0) {
+	  size_t written = s.next_out - out.data();
+	  if (written == out.size()) {
+	    out.resize(out.size()*2);
+	  }
+	  s.next_out = out.data() + written;
+	  s.avail_out = std::min<size_t>(out.size() - written, kMaxRoom);
+	}
+	return true;
+      });
+    out.resize(n < 0 ? 0 : n);
+    return n;
+  }
+
+  bool ZFileInflater::sizeFits() {
+    off64_t in_len = in_len_;
+    if (in_len < 0 && map_ != nullptr) {
+      in_len = map_->size() - offset_;
+    } else if (in_len < 0) {
+      struct stat sb;
+      in_len = fstat(fd_, &sb) == 0 ? sb.st_size - offset_ : -1;
+    }
+    if (size_ < -1 || (size_ > 0 && in_len >= 0 && size_/kMaxRatio > in_len)) {
+      std::cerr << "object larger than its zlib stream can inflate to\n";
+      return false;
+    }
+    return true;
+  }
+
+  ssize_t ZFileInflater::inflate(const Sink &sink, size_t chunk) {
+    // a streamed object has its size announced before the first chunk
+    if (!sizeFits()) {
       return -1;
     }
+    std::vector<uint8_t> buf(chunk);
+    return pump(buf.data(), buf.size(), [&](z_stream &s, bool) -> bool {
+	size_t produced = buf.size() - s.avail_out;
+	if (produced > 0 && !sink(buf.data(), produced)) {
+	  return false;
+	}
+	s.next_out = buf.data();
+	s.avail_out = buf.size();
+	return true;
+      });
+  }
 
-    int temp_fd = mkstemp(tmplate);
-    if (temp_fd < 0) {
-      perror("mkstemp");
+  ssize_t ZFileInflater::pump(uint8_t *out, size_t len, const Drain &drain) {
+    uint8_t input[kInputChunk];
+    off64_t pos = offset_;
+    // where the input stops, -1 if only zlib knows
+    off64_t end = in_len_ >= 0 ? offset_ + in_len_ : -1;
+    int ret;
+
+    ZStreamPool::Lease lease;
+    if (lease.strm == nullptr) {
+      std::cerr << "failed to initiaze z_stream\n";
       return -1;
     }
+    z_stream &strm = *lease.strm;
+    strm.next_out = out;
+    strm.avail_out = std::min<size_t>(len, kMaxRoom);
 
     bool eos = false;
-    uint32_t written = 0;
-    lseek64(fd_, offset_, SEEK_SET);
     while (!eos) {
-      strm.next_out = out;
-      strm.avail_out = ARRAY_SIZE(out);
-      do {
-	if (strm.avail_in == 0) {
-	  strm.avail_in = read(fd_, &input, ARRAY_SIZE(input));
-	  if (strm.avail_in < 0) {
-	    perror("read");
-	    close(temp_fd);
-	    return -1;
-	  }
+      if (strm.avail_out == 0 && !drain(strm, false)) {
+	return -1;
+      }
+      if (strm.avail_in == 0) {
+	ssize_t n;
+	if (map_ != nullptr) {
+	  // the whole stream in one span if its length is known
+	  n = std::min<off64_t>(map_->size() - pos,
+				end >= 0 ? std::min<off64_t>(end - pos, kMaxInputSpan)
+				: (off64_t)kInputChunk);
+	  const uint8_t *in = n > 0 ? map_->span(pos, n) : nullptr;
+	  if (in == nullptr) n = 0;
+	  strm.next_in = const_cast<uint8_t *>(in);
+	} else {
+	  size_t want = end >= 0 ? std::min<off64_t>(end - pos, ARRAY_SIZE(input))
+	    : ARRAY_SIZE(input);
+	  n = want > 0 ? pread64(fd_, &input, want, pos) : 0;
 	  strm.next_in = &input[0];
 	}
-	ret = ::inflate(&strm, Z_NO_FLUSH);
-	assert(ret != Z_STREAM_ERROR); /* state not clobbered */
-	switch (ret) {
-	case Z_STREAM_END:
-	  eos = true;
-	case Z_OK:
-	  break;
-	default:
-	  (void)inflateEnd(&strm);
-	  std::cerr << ret << " failed to inflate\n";
-	  close(temp_fd);
+	if (n <= 0) {
+	  if (n < 0) perror("pread");
+	  else std::cerr << "truncated zlib stream\n";
+	  return -1;
+	}
+	strm.avail_in = n;
+	pos += n;
+      }
+      ret = ::inflate(&strm, Z_NO_FLUSH);
+      assert(ret != Z_STREAM_ERROR); /* state not clobbered */
+      switch (ret) {
+      case Z_STREAM_END:
+	eos = true;
+      case Z_OK:
+	break;
+      case Z_BUF_ERROR:
+	if (strm.avail_out == 0) {
+	  std::cerr << "inflated object larger than expected\n";
 	  return -1;
 	}
-      } while (!eos && strm.avail_out > 0);
-      if (!eos) {
-	assert(strm.avail_out == 0);
+	break;
+      default:
+	std::cerr << ret << " failed to inflate\n";
+	return -1;
       }
-      written += write(temp_fd, out, ARRAY_SIZE(out)-strm.avail_out);
     }
-    (void)inflateEnd(&strm);
+    ssize_t written = strm.total_out;
+    if (!drain(strm, true)) {
+      return -1;
+    }
     if (size_ != -1 && written != size_) {
       std::cerr << ret << " failed to inflate pack completely\n";
-      close(temp_fd);
       return -1;
     }
-    // seek to 0 so that users don't have to seek to 0
-    // to get the file internals
-    lseek64(temp_fd, 0, SEEK_SET);
-    return temp_fd;
+    return written;
   }
 }
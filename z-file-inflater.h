@@ -1,13 +1,71 @@
 #pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+struct z_stream_s;
 
 namespace fusism {
+  struct MemoryMappedFile;
+
+  // inflates the zlib stream found at offset in fd (or in a mapped file).
+  // size is the expected inflated size, -1 if unknown.
+  // in_len is the compressed length of the stream, -1 if unknown.
+  // when it is known the input is taken in as few reads as possible
+  // and never past the end of the stream.
+  // input is read positionally (pread or the mapping), the file offset
+  // of fd is never touched, so several inflaters can work on the same
+  // fd from different threads. a MemoryMappedFile is not thread safe,
+  // each thread needs its own (they still share the mapped windows).
   struct ZFileInflater {
-    ZFileInflater(int fd, off64_t offset=0, off64_t size=-1);
+    // receives the inflated data chunk by chunk, in order.
+    // returning false stops the inflation
+    typedef std::function<bool(const uint8_t *data, size_t len)> Sink;
+
+    enum : size_t {
+      kStreamChunk = 64 << 10,
+      kInputChunk = 16 << 10,
+      // most a mapping is asked for at once, when in_len is known
+      kMaxInputSpan = 8 << 20,
+    };
+
+    ZFileInflater(int fd, off64_t offset=0, off64_t size=-1,
+		  off64_t in_len=-1);
+    // input is consumed straight from the mapping, without copies
+    ZFileInflater(MemoryMappedFile &map, off64_t offset, off64_t size=-1,
+		  off64_t in_len=-1);
     ~ZFileInflater();
-    int inflate();
+    // inflates into buf which is len bytes long.
+    // returns the number of inflated bytes or -1 on error
+    // (including running out of room in buf)
+    ssize_t inflate(uint8_t *buf, size_t len);
+    // inflates into out, which is resized to the inflated size.
+    // out's capacity is reused so callers can keep a buffer around
+    // across objects. returns the inflated size or -1 on error
+    ssize_t inflate(std::vector<uint8_t> &out);
+    // inflates through a buffer of chunk bytes, handing each filled
+    // chunk to sink. memory use is constant whatever the object size.
+    // returns the inflated size or -1 on error
+    ssize_t inflate(const Sink &sink, size_t chunk=kStreamChunk);
   private:
+    // hands the output produced so far in strm to the consumer and
+    // makes room for more if it can. called whenever zlib runs out of
+    // output space and once more at the end of the stream.
+    // returns false to abort
+    typedef std::function<bool(z_stream_s &strm, bool eos)> Drain;
+
+    // runs the zlib stream from the input through a pooled z_stream,
+    // starting with len bytes of output room at out
+    ssize_t pump(uint8_t *out, size_t len, const Drain &drain);
+    // false (and reported) if size can't come out of the input
+    // there is, the header it came from is corrupt
+    bool sizeFits();
+
+    MemoryMappedFile *map_;
     int fd_;
     off64_t offset_;
     off64_t size_;
+    off64_t in_len_;
   };
 }